@@ -0,0 +1,69 @@
+#pragma once
+#include <stddef.h>
+
+/*
+ * Bump-pointer allocator for memory sharing one lifetime, like the URL, the
+ * query parameters and the body of a request.
+ *
+ * The first block is provided by the owner, usually embedded in the object
+ * the arena belongs to, further chunks get allocated from the heap when it
+ * is full. Nothing is freed on its own, arena_reset() drops everything at
+ * once and gives the heap chunks back.
+ */
+
+// alignment of the allocations
+#define ARENA_ALIGN 8
+// smallest heap chunk, larger allocations get a chunk of their own
+#define ARENA_CHUNK_SIZE 4096
+
+typedef struct arena_chunk_s arena_chunk_t;
+
+typedef struct arena_s {
+  char *base;      /* block allocations are carved from */
+  size_t used;     /* bytes used in the block */
+  size_t capacity; /* bytes of the block */
+  char *first;     /* block provided by the owner */
+  size_t capacity_first;
+  arena_chunk_t *chunks; /* heap chunks, the current one first */
+  char *last;            /* latest allocation, may grow in place */
+} arena_t;
+
+/**
+ * @brief Initializes an arena over a block provided by the owner.
+ *
+ * @param arena Pointer to the arena.
+ * @param block First block, aligned on ARENA_ALIGN, may be NULL.
+ * @param size  Bytes of the block.
+ */
+void arena_init(arena_t *arena, void *block, size_t size);
+
+/**
+ * @brief Allocates memory aligned on ARENA_ALIGN.
+ *
+ * @return Returns the memory, or NULL if out of memory.
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * @brief Grows an allocation, in place when it is the latest one.
+ *
+ * @param arena    Pointer to the arena.
+ * @param ptr      Allocation to grow, or NULL.
+ * @param old_size Bytes of the allocation.
+ * @param size     Bytes needed.
+ * @return Returns the allocation, moved if needed, or NULL if out of memory,
+ *         the old one is left untouched then.
+ */
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t size);
+
+/**
+ * @brief Copies a string into the arena.
+ *
+ * @return Returns the NUL terminated copy, or NULL if out of memory.
+ */
+char *arena_strndup(arena_t *arena, const char *s, size_t len);
+
+/**
+ * @brief Releases every allocation at once and frees the heap chunks.
+ */
+void arena_reset(arena_t *arena);
@@ -0,0 +1,62 @@
+#pragma once
+#include "defineds.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+/*
+ * Streaming gzip (zlib, HAVE_ZLIB) and brotli (libbrotlienc, HAVE_BROTLI)
+ * compression into a growing memory buffer. Nothing in here touches a loop,
+ * a compressor is meant to run on the threadpool.
+ */
+
+// content codings, as bits
+#define CONTENT_ENCODING_BR (1 << 0)
+#define CONTENT_ENCODING_GZIP (1 << 1)
+
+typedef struct compressor_s {
+  uint8_t encoding; /* CONTENT_ENCODING_xxx */
+  void *state;      /* z_stream or BrotliEncoderState */
+  char *output;     /* compressed bytes, taken over by the caller or freed */
+  size_t length_output;
+  size_t capacity;
+} compressor_t;
+
+/**
+ * @brief Tells which content codings this build can compress with.
+ *
+ * @return Returns the CONTENT_ENCODING_xxx bits.
+ */
+uint8_t compressor_encodings(void);
+
+/**
+ * @brief Sets up a compressor.
+ *
+ * @param c         Pointer to the compressor.
+ * @param encoding  CONTENT_ENCODING_xxx.
+ * @param level     1 (fastest) to 9 (smallest), also the brotli quality.
+ * @param size_hint Expected size of the input, 0 if unknown.
+ *
+ * @return Returns 0 on success, UV_ENOSYS if the encoding isn't built in, or
+ *         UV_ENOMEM.
+ */
+int compressor_init(compressor_t *c, uint8_t encoding, int level,
+                    size_t size_hint);
+
+/**
+ * @brief Compresses the next bytes of the input.
+ *
+ * @param c      Pointer to the compressor.
+ * @param data   The bytes.
+ * @param len    Number of bytes.
+ * @param finish true for the last bytes, the output is then complete.
+ *
+ * @return Returns 0 on success, or a libuv error code.
+ */
+int compressor_write(compressor_t *c, const char *data, size_t len,
+                     bool finish);
+
+/**
+ * @brief Releases a compressor, and its output unless set to NULL.
+ */
+void compressor_free(compressor_t *c);
@@ -0,0 +1,130 @@
+#pragma once
+#include "defineds.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+/*
+ * Cache of open files and their stat, keyed by the filesystem path, so the
+ * files served over and over are neither looked up nor opened again. A
+ * directory is kept without file descriptor, that saves the lookup of the
+ * default files. A path found missing is kept as well, with a zeroed stat
+ * (st_mode 0), so it isn't looked up on every request.
+ *
+ * Entries not used for a while are closed by a timer of the cache, entries
+ * older than the validity are checked against a fresh stat before being
+ * used again. The cache belongs to one worker and is not thread safe.
+ */
+
+typedef struct fdcache_entry_s {
+  char *path;
+  size_t length_path;
+  uint32_t hash;
+  uv_file fd; /* -1 for a directory */
+  uv_stat_t stat;
+  uint64_t expire;    /* loop time (ms) the entry has to be revalidated */
+  uint64_t last_used; /* loop time (ms) of the last lookup */
+  uint32_t refcount;  /* the cache and every response using the entry */
+  bool linked;        /* still in the cache */
+
+  struct fdcache_entry_s *hnext;       /* hash chain */
+  struct fdcache_entry_s *prev, *next; /* for utlist, LRU order */
+} fdcache_entry_t;
+
+typedef struct fdcache_s {
+  fdcache_entry_t **buckets;
+  uint32_t num_buckets;
+  uint32_t count;
+  fdcache_entry_t *lru; /* most recently used first */
+  uint32_t max_entries;
+  uint32_t valid;    /* ms an entry is used without revalidation */
+  uint32_t inactive; /* ms an unused entry is kept open */
+  uv_timer_t timer;  /* closes the inactive entries */
+} fdcache_t;
+
+/**
+ * @brief Initializes a file descriptor cache.
+ *
+ * @param cache       Pointer to the cache.
+ * @param loop        Loop running the inactivity timer.
+ * @param max_entries Number of files kept open, 0 disables the cache.
+ * @param valid       Milliseconds an entry is used without revalidation.
+ * @param inactive    Milliseconds an unused entry is kept open.
+ *
+ * @return Returns 0 on success, or a libuv error code.
+ */
+int fdcache_init(fdcache_t *cache, uv_loop_t *loop, uint32_t max_entries,
+                 uint32_t valid, uint32_t inactive);
+
+/**
+ * @brief Stops the inactivity timer, the handle is released by the loop.
+ */
+void fdcache_stop(fdcache_t *cache);
+
+/**
+ * @brief Closes all the entries of a cache not used by a response anymore.
+ */
+void fdcache_destroy(fdcache_t *cache);
+
+/**
+ * @brief Looks up an entry and acquires a reference on it.
+ *
+ * @param cache Pointer to the cache.
+ * @param path  Filesystem path.
+ * @param len   Length of the path.
+ * @param now   Current loop time in ms.
+ * @param stale Set to true if the entry has to be revalidated with
+ *              fdcache_same_file() before use.
+ *
+ * @return Returns the entry, to be released with fdcache_release(), or NULL.
+ */
+fdcache_entry_t *fdcache_lookup(fdcache_t *cache, const char *path, size_t len,
+                                uint64_t now, bool *stale);
+
+/**
+ * @brief Allocates an entry for an opened file or a directory.
+ *
+ * @param path Filesystem path.
+ * @param len  Length of the path.
+ * @param fd   The open file, -1 for a directory. Closed with the entry.
+ * @param stat Stat of the file.
+ *
+ * @return Returns the entry holding one reference, or NULL.
+ */
+fdcache_entry_t *fdcache_entry_new(const char *path, size_t len, uv_file fd,
+                                   const uv_stat_t *stat);
+
+/**
+ * @brief Inserts an entry, replacing an entry with the same path.
+ *
+ * Evicts the least recently used entry once the cache is full, the caller
+ * keeps its own reference.
+ */
+void fdcache_insert(fdcache_t *cache, fdcache_entry_t *entry, uint64_t now);
+
+/**
+ * @brief Tells whether a fresh stat still describes the file of an entry.
+ */
+bool fdcache_same_file(const fdcache_entry_t *entry, const uv_stat_t *stat);
+
+/**
+ * @brief Marks a stale entry valid again, once checked with
+ *        fdcache_same_file().
+ */
+void fdcache_revalidate(fdcache_t *cache, fdcache_entry_t *entry,
+                        uint64_t now);
+
+/**
+ * @brief Removes the entry of a path, if any.
+ */
+void fdcache_remove(fdcache_t *cache, const char *path, size_t len);
+
+/**
+ * @brief Removes the entry of a path and the entries of all the paths below.
+ */
+void fdcache_remove_tree(fdcache_t *cache, const char *path, size_t len);
+
+/**
+ * @brief Releases a reference, the file is closed once unused and evicted.
+ */
+void fdcache_release(fdcache_entry_t *entry);
@@ -0,0 +1,110 @@
+#pragma once
+#include "defineds.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * LRU cache of small static files. An entry holds the prebuilt response
+ * header (without the Connection field and the empty line) followed by the
+ * empty line and the file content, so a hit is answered straight from memory.
+ *
+ * The cache belongs to one worker and is not thread safe.
+ */
+
+typedef struct filecache_entry_s {
+  char *key; /* normalized URL */
+  size_t length_key;
+  uint32_t hash;
+  char *data;           /* header, "\r\n", content */
+  size_t length_header; /* header part of data */
+  size_t length_data;
+  uint64_t expire;   /* loop time (ms) the entry has to be revalidated */
+  uint32_t refcount; /* the cache and every response using the entry */
+  bool linked;       /* still in the cache */
+
+  struct filecache_entry_s *hnext;       /* hash chain */
+  struct filecache_entry_s *prev, *next; /* for utlist, LRU order */
+} filecache_entry_t;
+
+typedef struct filecache_s {
+  filecache_entry_t **buckets;
+  uint32_t num_buckets;
+  uint32_t count;
+  filecache_entry_t *lru; /* most recently used first */
+  size_t size;            /* bytes held by the linked entries */
+  size_t max_size;
+  size_t max_file_size;
+  uint32_t valid; /* ms an entry is served without revalidation */
+} filecache_t;
+
+/**
+ * @brief Initializes a file cache.
+ *
+ * @param cache         Pointer to the cache.
+ * @param max_size      Byte budget of the cache, 0 disables it.
+ * @param max_file_size Largest file content kept in the cache.
+ * @param valid         Milliseconds an entry is served without revalidation.
+ *
+ * @return Returns 0 on success, or -1 if the memory can't be allocated.
+ */
+int filecache_init(filecache_t *cache, size_t max_size, size_t max_file_size,
+                   uint32_t valid);
+
+/**
+ * @brief Releases all the entries of a cache not used by a response anymore.
+ */
+void filecache_destroy(filecache_t *cache);
+
+/**
+ * @brief Looks up a valid entry and acquires a reference on it.
+ *
+ * @param cache Pointer to the cache.
+ * @param key   Normalized URL.
+ * @param len   Length of the key.
+ * @param now   Current loop time in ms.
+ *
+ * @return Returns the entry, to be released with filecache_release(), or
+ *         NULL on a miss or if the entry has expired.
+ */
+filecache_entry_t *filecache_lookup(filecache_t *cache, const char *key,
+                                    size_t len, uint64_t now);
+
+/**
+ * @brief Allocates an entry, the caller fills in its data.
+ *
+ * @param key           Normalized URL.
+ * @param len           Length of the key.
+ * @param header        Prebuilt response header.
+ * @param length_header Length of the header.
+ * @param length_body   Size of the file content.
+ *
+ * @return Returns the entry holding one reference, or NULL.
+ */
+filecache_entry_t *filecache_entry_new(const char *key, size_t len,
+                                       const char *header, size_t length_header,
+                                       size_t length_body);
+
+/**
+ * @brief Inserts an entry, replacing an entry with the same key.
+ *
+ * Evicts least recently used entries until the budget is met, the caller
+ * keeps its own reference.
+ */
+void filecache_insert(filecache_t *cache, filecache_entry_t *entry,
+                      uint64_t now);
+
+/**
+ * @brief Removes the entry of a key, if any.
+ */
+void filecache_remove(filecache_t *cache, const char *key, size_t len);
+
+/**
+ * @brief Removes the entry of a key and the entries of all the keys below it
+ *        ("/dir" removes "/dir", "/dir/" and "/dir/file" but not "/dirx").
+ */
+void filecache_remove_tree(filecache_t *cache, const char *key, size_t len);
+
+/**
+ * @brief Releases a reference, the entry is freed once unused and evicted.
+ */
+void filecache_release(filecache_entry_t *entry);
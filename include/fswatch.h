@@ -0,0 +1,69 @@
+#pragma once
+#include "defineds.h"
+#include <uv.h>
+
+/*
+ * Recursive watch of a directory tree with uv_fs_event_t. libuv watches a
+ * single directory per handle on Linux (inotify), so one handle is kept for
+ * every directory of the tree and directories created later get added.
+ *
+ * Changes are reported with paths relative to the root, in the form of the
+ * normalized URLs ("/dir/file", "" for the root itself).
+ *
+ * Every directory takes an inotify watch (fs.inotify.max_user_watches), a
+ * directory created later gets scanned for subdirectories on the threadpool.
+ */
+
+struct fswatch_s;
+typedef struct fswatch_s fswatch_t;
+
+/**
+ * @brief Called for every path whose content may have changed.
+ *
+ * @param watch Pointer to the watch.
+ * @param path  Relative path, not NUL terminated.
+ * @param len   Length of the path.
+ * @param tree  true if everything below path may have changed as well.
+ */
+typedef void (*fswatch_cb)(fswatch_t *watch, const char *path, size_t len,
+                           bool tree);
+
+typedef struct fswatch_dir_s {
+  uv_fs_event_t handle;
+  fswatch_t *watch;
+  char *path; /* relative to the root */
+  size_t length_path;
+  struct fswatch_dir_s *prev, *next; /* for utlist */
+} fswatch_dir_t;
+
+struct fswatch_s {
+  uv_loop_t *loop;
+  char *root;
+  size_t length_root;
+  fswatch_dir_t *dirs;
+  fswatch_cb on_change;
+  void *data;
+};
+
+/**
+ * @brief Starts watching a directory tree.
+ *
+ * The tree is scanned synchronously, it is meant to be called before serving.
+ *
+ * @param watch     Pointer to the watch.
+ * @param loop      Loop running the watch.
+ * @param root      Directory to watch.
+ * @param on_change Callback for the changes.
+ *
+ * @return Returns 0 on success, or a libuv error code.
+ */
+int fswatch_start(fswatch_t *watch, uv_loop_t *loop, const char *root,
+                  fswatch_cb on_change);
+
+/**
+ * @brief Stops watching, the handles are released by the loop.
+ *
+ * A scan of a new directory still running completes on the loop, the watch
+ * has to stay around until the loop is done.
+ */
+void fswatch_stop(fswatch_t *watch);
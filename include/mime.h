@@ -0,0 +1,76 @@
+#pragma once
+#include "defineds.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Content types by file extension, the built-in types and optionally the
+ * ones of a mime.types file, in a perfect hash built at startup: a lookup
+ * hashes the extension twice and compares it with a single entry.
+ *
+ * Every type comes with its Content-Type header line rendered in advance.
+ * The table is read only once built, the workers share it.
+ */
+
+// type of the files without a known extension
+#define MIME_DEFAULT_TYPE "application/octet-stream"
+
+typedef struct mime_type_pair_s {
+  const char *ext; /* lowercase, without the dot */
+  const char *content_type;
+} mime_type_pair_t;
+
+typedef struct mime_type_s {
+  const char *content_type;
+  const char *header; /* "Content-Type: <content_type>\r\n" */
+  uint32_t length_header;
+} mime_type_t;
+
+typedef struct mime_entry_s {
+  const char *ext; /* NULL for the empty slots */
+  mime_type_t type;
+} mime_entry_t;
+
+// MIME_DEFAULT_TYPE with its header line
+extern const mime_type_t mime_default_type;
+
+typedef struct mime_table_s {
+  mime_entry_t *slots;
+  uint32_t num_slots;
+  uint32_t *seeds; /* seed of the slot hash, per bucket */
+  uint32_t num_buckets;
+  uint32_t num_types;
+  char *data;    /* contents of the mime.types file, NULL if none */
+  char *headers; /* the header lines of the slots */
+} mime_table_t;
+
+/**
+ * @brief Builds the table from the built-in types and a mime.types file.
+ *
+ * Every line of the file has a type followed by its extensions, '#' starts a
+ * comment. The types of the file win over the built-in ones.
+ *
+ * @param table Pointer to the table.
+ * @param path  The mime.types file, NULL for the built-in types only.
+ *
+ * @return Returns 0 on success, a libuv error code if the file can't be
+ *         read (the table then has the built-in types), or UV_ENOMEM.
+ */
+int mime_table_init(mime_table_t *table, const char *path);
+
+/**
+ * @brief Releases the memory of a table.
+ */
+void mime_table_free(mime_table_t *table);
+
+/**
+ * @brief Looks up the content type of a file.
+ *
+ * @param table Pointer to the table.
+ * @param path  File name or path, its extension is compared
+ *              case-insensitively.
+ *
+ * @return Returns the type, &mime_default_type if unknown.
+ */
+const mime_type_t *mime_table_lookup(const mime_table_t *table,
+                                     const char *path);
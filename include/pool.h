@@ -0,0 +1,66 @@
+#pragma once
+#include "defineds.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Free list of fixed-size memory blocks, aligned on a cache line so objects
+ * of different connections don't share one.
+ *
+ * The blocks either get allocated one by one, released blocks are then kept
+ * for the next allocation up to a limit and the others go back to the
+ * allocator, or carved out of slabs of several blocks which stay with the
+ * pool until pool_destroy().
+ *
+ * A pool belongs to one worker and is not thread safe.
+ */
+
+// alignment and size granularity of the blocks
+#define POOL_ALIGN 64
+
+typedef struct pool_s {
+  size_t size;       /* bytes of a block, a multiple of POOL_ALIGN */
+  uint32_t max_free; /* most free blocks kept, without slabs */
+  uint32_t per_slab; /* blocks per slab, 0 to allocate them one by one */
+  void *slabs;       /* a slab starts with the next one */
+  void *free_list;   /* a free block starts with the next one */
+  uint32_t num_free;
+  uint32_t in_use; /* blocks handed out and not released yet */
+  uint32_t peak_in_use;
+  uint64_t gets;    /* blocks handed out */
+  uint64_t mallocs; /* calls to the allocator, for a block or a slab */
+  uint64_t frees;   /* released blocks given back to the allocator */
+} pool_t;
+
+/**
+ * @brief Initializes a pool, no memory is allocated until the first block
+ *        is needed.
+ *
+ * @param pool     Pointer to the pool.
+ * @param size     Bytes of a block, rounded up to POOL_ALIGN.
+ * @param max_free Most free blocks kept when allocated one by one, 0 to
+ *                 always give them back.
+ * @param per_slab Blocks allocated at once, 0 to allocate them one by one.
+ */
+void pool_init(pool_t *pool, size_t size, uint32_t max_free,
+               uint32_t per_slab);
+
+/**
+ * @brief Releases the free blocks and the slabs of a pool.
+ *
+ * The blocks in use allocated one by one are left to their owners, the
+ * blocks of a slab must not be used anymore.
+ */
+void pool_destroy(pool_t *pool);
+
+/**
+ * @brief Gets a block, from the free list if possible.
+ *
+ * @return Returns the block, or NULL if out of memory.
+ */
+void *pool_get(pool_t *pool);
+
+/**
+ * @brief Releases a block got from pool_get(), NULL is ignored.
+ */
+void pool_put(pool_t *pool, void *block);
@@ -0,0 +1,67 @@
+#pragma once
+#include "arena.h"
+#include "defineds.h"
+#include <stdint.h>
+
+/*
+ * Query string of a request, split into its parameters only when first
+ * looked at. The parameters are slices of the query itself, a name or value
+ * with escapes gets decoded into the arena of the request, the names when
+ * the query is split and the values when they are asked for.
+ */
+
+typedef struct query_param_s {
+  const char *name; /* not NUL terminated */
+  const char *value; /* not NUL terminated, empty without '=' */
+  uint32_t length_name;
+  uint32_t length_value;
+  bool decoded; /* value has no escapes left */
+} query_param_t;
+
+typedef struct query_s {
+  const char *data; /* after the '?' of the target, NULL if none */
+  uint32_t length;
+  query_param_t *params; /* in the order received, from the arena */
+  uint32_t num_params;
+  bool parsed; /* params is valid */
+} query_t;
+
+/**
+ * @brief Sets the query string, nothing is parsed yet.
+ *
+ * @param query  Pointer to the query.
+ * @param data   Bytes after the '?', must outlive the query.
+ * @param length Length of data.
+ */
+void query_init(query_t *query, const char *data, uint32_t length);
+
+/**
+ * @brief Gets the next parameter, parses the query on the first call.
+ *
+ * The empty parameters ("a=1&&b=2") are skipped, a name without '=' has an
+ * empty value.
+ *
+ * @param query Pointer to the query.
+ * @param arena Arena the parameters and decoded values go to.
+ * @param index Index of the parameter to start at, receives the index after
+ *              the returned one. Start with 0.
+ *
+ * @return Returns the parameter with its value decoded, or NULL past the last
+ *         one or if out of memory.
+ */
+const query_param_t *query_next(query_t *query, arena_t *arena,
+                                uint32_t *index);
+
+/**
+ * @brief Looks up a parameter by name.
+ *
+ * @param query Pointer to the query.
+ * @param arena Arena the parameters and decoded values go to.
+ * @param name  Decoded name, compared case-sensitively.
+ * @param len   Receives the length of the value, may be NULL.
+ *
+ * @return Returns the decoded value of the first parameter with this name,
+ *         not NUL terminated, or NULL if there is none.
+ */
+const char *query_get(query_t *query, arena_t *arena, const char *name,
+                      uint32_t *len);
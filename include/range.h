@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Parsing of the Range header field (RFC 9110, section 14), only byte ranges
+ * are supported.
+ */
+
+// most ranges answered in one multipart/byteranges response, a request asking
+// for more gets the whole content
+#define RANGE_MAX 16
+
+typedef struct range_s {
+  uint64_t start; /* first byte */
+  uint64_t end;   /* past the last byte */
+  // part header of a multipart/byteranges response, in response->parts
+  size_t part_header;
+  size_t length_part_header;
+} range_t;
+
+/**
+ * @brief Parses the value of a Range header field.
+ *
+ * The ranges are clamped to the content, the ranges starting past the end of
+ * the content are left out.
+ *
+ * @param value  The field value, not NUL terminated.
+ * @param len    Length of the value.
+ * @param size   Size of the content.
+ * @param ranges Receives the satisfiable ranges, in the requested order.
+ * @param max    Capacity of ranges.
+ *
+ * @return Returns the number of satisfiable ranges, 0 if none is (416), or -1
+ *         if the field is invalid, not about bytes or asks for more than max
+ *         ranges, the whole content is then sent.
+ */
+int range_parse(const char *value, size_t len, uint64_t size, range_t *ranges,
+                uint32_t max);
@@ -0,0 +1,116 @@
+#pragma once
+#include "defineds.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+/*
+ * Static file operations on io_uring, for a worker loop. The requests look
+ * like uv_fs_t: the result is a file descriptor or a byte count, or a libuv
+ * error code, and the callback runs on the loop.
+ *
+ * The completions are signaled through an eventfd polled by the loop, the
+ * submissions of a loop iteration go to the kernel in one batch before the
+ * loop blocks. Without liburing (HAVE_LIBURING), or if the kernel can't run
+ * the operations, uring_init() fails and the threadpool is used instead.
+ */
+
+typedef struct uring_s uring_t;
+typedef struct uring_req_s uring_req_t;
+
+typedef void (*uring_cb)(uring_req_t *req);
+
+struct uring_req_s {
+  void *data;
+  uring_t *ring;
+  uring_cb cb;
+  ssize_t result;    /* fd or bytes, or a libuv error code */
+  uv_stat_t statbuf; /* uring_stat() and uring_open_stat() */
+  char *path;
+  uint8_t type;
+  int stat_result;
+  uint32_t pending; /* completions still to come */
+#ifdef HAVE_LIBURING
+  struct statx statx;
+#endif
+};
+
+struct uring_s {
+  bool active;
+#ifdef HAVE_LIBURING
+  struct io_uring ring;
+  int event_fd;
+  uv_poll_t event_poll;   /* completions */
+  uv_prepare_t submitter; /* submits the queued requests */
+  uint32_t unsubmitted;
+  uint32_t inflight;
+#endif
+};
+
+/**
+ * @brief Sets up a ring for a loop.
+ *
+ * @param ring    Pointer to the ring.
+ * @param loop    Loop running the callbacks.
+ * @param entries Size of the submission queue.
+ *
+ * @return Returns 0 on success, UV_ENOSYS if built without liburing or
+ *         UV_ENOTSUP if the kernel lacks an operation, or a libuv error code.
+ */
+int uring_init(uring_t *ring, uv_loop_t *loop, uint32_t entries);
+
+/**
+ * @brief Stops watching the completions, the handles are released by the
+ *        loop.
+ */
+void uring_stop(uring_t *ring);
+
+/**
+ * @brief Waits for the requests in flight, running their callbacks, and
+ *        releases the ring. To be called once the loop has been stopped.
+ */
+void uring_destroy(uring_t *ring);
+
+/**
+ * @brief Stats a path (statx).
+ *
+ * @return Returns 0 if the request is queued, or a libuv error code.
+ */
+int uring_stat(uring_t *ring, uring_req_t *req, const char *path, uring_cb cb);
+
+/**
+ * @brief Stats and opens a path read only, as two linked operations.
+ *
+ * The file is opened with O_NONBLOCK, so a fifo can't block the kernel
+ * worker. req->result is the file descriptor, or the error of the stat or
+ * the open.
+ *
+ * @return Returns 0 if the request is queued, or a libuv error code.
+ */
+int uring_open_stat(uring_t *ring, uring_req_t *req, const char *path,
+                    uring_cb cb);
+
+/**
+ * @brief Reads from a file at an offset.
+ *
+ * @return Returns 0 if the request is queued, or a libuv error code.
+ */
+int uring_read(uring_t *ring, uring_req_t *req, uv_file fd, char *buf,
+               size_t len, int64_t offset, uring_cb cb);
+
+/**
+ * @brief Moves bytes of a file at an offset into a pipe.
+ *
+ * @return Returns 0 if the request is queued, or a libuv error code.
+ */
+int uring_splice(uring_t *ring, uring_req_t *req, uv_file fd, int64_t offset,
+                 int pipe_fd, size_t len, uring_cb cb);
+
+/**
+ * @brief Releases the memory held by a completed request.
+ */
+void uring_req_cleanup(uring_req_t *req);
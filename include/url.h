@@ -0,0 +1,21 @@
+#pragma once
+#include <stddef.h>
+
+/**
+ * @brief Percent-decodes and normalizes the path of a request target in
+ *        place.
+ *
+ * The escapes get decoded, runs of slashes and backslashes become a single
+ * slash, "." segments are dropped and ".." segments remove the segment
+ * before them without ever going above the root. The decoded bytes take
+ * part in the resolution, so "%2e%2e" is a ".." segment, but are never
+ * decoded twice.
+ *
+ * @param path The path, without the query, with room for len + 1 bytes.
+ * @param len  Length of the path.
+ *
+ * @return Returns the length of the NUL terminated normalized path, or -1 if
+ *         the path doesn't start with a slash, has a malformed escape or
+ *         decodes to a NUL or a separator.
+ */
+int url_normalize_path(char *path, size_t len);
@@ -1,3 +1,32 @@
 #pragma once
+#include "defineds.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 
+int normalize_path(const char *path, size_t len, char *output, size_t size);
 char *validate_and_normalize_path(const char *path);
+uint32_t hash_string(const char *str, size_t len);
+int read_file(const char *path, char **data, size_t *length);
+
+// most digits of a 64 bits unsigned integer
+#define UINT64_DIGITS 20
+
+size_t format_uint64(uint64_t value, char *buf);
+
+// length of an IMF-fixdate with its NUL terminator
+#define HTTP_DATE_SIZE 30
+
+size_t http_date_format(time_t t, char *buf);
+
+// dates kept formatted by http_date_cached()
+#define HTTP_DATE_CACHE_SIZE 16
+
+typedef struct http_date_cache_s {
+  time_t times[HTTP_DATE_CACHE_SIZE];
+  char dates[HTTP_DATE_CACHE_SIZE][HTTP_DATE_SIZE]; /* empty if unused */
+} http_date_cache_t;
+
+void http_date_cache_init(http_date_cache_t *cache);
+const char *http_date_cached(http_date_cache_t *cache, time_t t);
+bool http_date_parse(const char *str, size_t len, time_t *t);
@@ -1,8 +1,18 @@
 #pragma once
 #include "defineds.h"
+#include "arena.h"
+#include "compress.h"
+#include "fdcache.h"
+#include "filecache.h"
+#include "fswatch.h"
+#include "mime.h"
+#include "pool.h"
+#include "query.h"
+#include "range.h"
+#include "uring.h"
+#include "utils.h"
 #include <llhttp.h>
 #include <stdint.h>
-#include <utarray.h>
 #include <utlist.h>
 #include <uv.h>
 
@@ -16,86 +26,257 @@ typedef struct webconfig_s {
   uint16_t port;
   char *www_root; /* local path */
   bool cors;      /* CORS */
+  uint32_t workers; /* event loop threads, 0 = one per CPU core */
+  uint32_t keepalive_timeout;  /* idle keep-alive timeout in ms, 0 = off */
+  uint32_t keepalive_requests; /* max requests per connection, 0 = no limit */
+  uint32_t pipeline_depth;     /* max requests queued per connection */
+  size_t filecache_size;       /* memory for small files, 0 = no cache */
+  size_t filecache_max_file;   /* largest file kept in memory (and sent with
+                                  its header in a single write) */
+  uint32_t filecache_valid;    /* ms a cached file is served without stat */
+  uint32_t fdcache_max;      /* open files kept per worker, 0 = no cache */
+  uint32_t fdcache_valid;    /* ms an open file is used without stat */
+  uint32_t fdcache_inactive; /* ms an unused file is kept open, 0 = forever */
+  bool sendfile_direct; /* sendfile() on the loop thread for cached pages */
+  uint8_t file_engine;  /* FILE_ENGINE_xxx, stat/open/read of the files */
+  bool www_watch; /* watch www_root, drop cached content once changed. A
+                     single watch serves the workers, it takes an inotify
+                     watch per directory. Out of watches, cached content
+                     lives until filecache_valid */
+  bool precompressed; /* serve file.br / file.gz if the client accepts it */
+  uint8_t compress_level;     /* on-the-fly gzip/brotli 1-9, 0 = off */
+  uint32_t compress_min_size; /* smaller contents are sent as is */
+  size_t compress_max_size;   /* larger files are sent as is */
+  size_t compress_cache_size; /* memory for compressed files, 0 = no cache */
+  const char **compress_types; /* MIME types compressed, NULL terminated */
+  const char *mime_types_file; /* mime.types added to the built-in types, NULL
+                                  for the built-in types only */
+  const char *error_pages_dir; /* "<status>.html" pages replacing the
+                                  built-in error pages, NULL for none */
+  uint32_t read_buffer_size; /* bytes of a pooled connection read buffer */
+  uint32_t read_buffer_pool; /* free read buffers kept per worker */
   uint32_t def_cnt;
   char *defaults[]; /* default files */
 } webconfig_t;
 
+// the libuv threadpool
+#define FILE_ENGINE_THREADPOOL 0
+// io_uring if built with liburing and supported by the kernel, the threadpool
+// otherwise
+#define FILE_ENGINE_IO_URING 1
+
+// submission queue entries of the io_uring of a worker
+#define URING_ENTRIES 256
+
+// "Date: <IMF-fixdate>\r\n" with its NUL terminator
+#define DATE_HEADER_SIZE (sizeof("Date: \r\n") - 1 + HTTP_DATE_SIZE)
+
 struct client_s;
 typedef struct client_s client_t;
 
-typedef struct get_param_s {
-  char *name;
-  char *value;
-} get_param_t;
+/*
+ * An error response serialized at startup, everything but the Date and
+ * Connection fields, sent as it is.
+ */
+typedef struct error_page_s {
+  char *data; /* header fields, "\r\n" and the content */
+  uint32_t length_header; /* of the fields before the "\r\n" */
+  uint32_t length;
+} error_page_t;
 
-typedef struct response_s {
-  char *path_content;
+// the statuses with an error page: 400, 401, 404 and 500
+#define NUM_ERROR_PAGES 4
+
+// a change below www_root, handed by the watch of the server to a worker
+typedef struct www_change_s {
+  bool tree; /* everything below path may have changed */
   size_t length_path;
+  struct www_change_s *prev, *next; /* for utlist */
+  char path[];                       /* normalized URL, NUL terminated */
+} www_change_t;
+
+/*
+ * Per event loop context. Every worker owns its loop, listen socket, client
+ * list and timers, nothing in here is shared with the other workers.
+ */
+typedef struct worker_s {
+  uint32_t id;
+  uint32_t num_workers;
+  uv_loop_t *loop;
+  uv_loop_t thread_loop; /* loop storage when running on its own thread */
+  uv_thread_t thread;
+  uv_sem_t *ready; /* posted once the listen socket is up (or failed) */
+  int status;      /* result of binding/listening */
+  webconfig_t *config;
+  const mime_table_t *mime_types; /* shared by the workers */
+  const error_page_t *error_pages; /* NUM_ERROR_PAGES, shared */
+  llhttp_settings_t settings;
+  uv_tcp_t server;
+  uv_async_t stop_async;
+  uv_async_t stats_async; /* prints the counters of the worker */
+  client_t *activeClientList; /* open and closing clients */
+  filecache_t filecache; /* share of config->filecache_size */
+  filecache_t compcache; /* compressed files, share of compress_cache_size */
+  fdcache_t fdcache;     /* open files and directories */
+  fswatch_t *fswatch;    /* the watch of the server if on this loop */
+  uv_async_t changes_async; /* changes queued by the watch */
+  uv_mutex_t changes_lock;
+  www_change_t *changes; /* not dropped yet, under changes_lock */
+  uring_t uring;         /* FILE_ENGINE_IO_URING, active if available */
+  pool_t read_buffers;   /* read buffers of read_buffer_size */
+  uint64_t large_read_buffers; /* allocated for larger request headers */
+  // responses by how much uv_try_write took at once, see write_response()
+  uint64_t writes_direct;  /* all of it */
+  uint64_t writes_partial; /* the rest queued with uv_write */
+  uint64_t writes_queued;  /* none of it, all queued */
+  // recycled objects of the connections, in slabs
+  pool_t clients;
+  pool_t requests;
+  pool_t write_reqs;  /* uv_write_t */
+  pool_t fs_reqs;     /* uv_fs_t */
+  pool_t uring_reqs;  /* uring_req_t */
+  pool_t headers;     /* response headers of RESPONSE_HEADER_SIZE */
+  uv_timer_t date_timer; /* formats date_header at every second */
+  char date_header[DATE_HEADER_SIZE]; /* "Date: <IMF-fixdate>\r\n" */
+  uint32_t length_date_header;
+  http_date_cache_t last_modified; /* of the files served lately */
+} worker_t;
+
+/*
+ * Bytes received on a connection. The header fields of the requests are
+ * slices of it rather than copies, so a buffer lives as long as its client
+ * reads into it or a request refers to it.
+ */
+typedef struct read_buffer_s {
+  pool_t *pool; /* pool of the buffer, NULL if allocated on its own */
+  uint32_t refcount;
+  uint32_t capacity;
+  uint32_t length; /* bytes received */
+  char data[];
+} read_buffer_t;
+
+/*
+ * A header field of a request, as offsets into the read buffer of the
+ * request.
+ */
+typedef struct header_entry_s {
+  uint32_t field; /* offset of the field name */
+  uint32_t value; /* offset of the value, valid once length_value > 0 */
+  uint32_t length_field;
+  uint32_t length_value;
+} header_entry_t;
+
+// header fields kept in the request itself, the others spill to the arena
+#define REQUEST_INLINE_HEADERS 16
+// first block of the arena of a request, enough for a typical GET
+#define REQUEST_ARENA_SIZE 1024
+
+typedef struct response_s {
   size_t size_content;
-  const char *mime_content;
-  uv_buf_t *buf;
-  uv_file open_file;
+  const mime_type_t *mime; /* type of the content, NULL if none */
+  char *header; /* response header from worker->headers, NULL if none */
+  filecache_entry_t *cached; /* content from the file cache */
+  uv_buf_t buf[3];
+  uint32_t nbufs;
+  fdcache_entry_t *file; /* file to send after buf, NULL if none */
+  size_t sent;           /* offset in file sent (or bytes loaded) so far */
+  size_t send_end;       /* offset in file to send up to */
+  range_t *ranges; /* ranges of file sent, NULL for the whole file, arena */
+  uint32_t num_ranges;
+  uint32_t range_index; /* range being sent */
+  char *parts; /* multipart/byteranges: boundary and part headers, arena */
+  size_t piped;          /* bytes of sent still in the client pipe */
+  bool keep_alive;       /* keep the connection open after this response */
+  uint8_t content_encoding; /* CONTENT_ENCODING_xxx of file, 0 for none */
+  bool compressed;          /* content_encoding applied on the fly */
+  char *body;               /* content in heap, NULL if none */
+  bool vary_encoding;       /* the content depends on Accept-Encoding */
 } response_t;
 
 typedef struct request_s {
+  client_t *client;
   uint8_t method;
-  char *url;
+  uint8_t state; /* REQUEST_STATE_xxx */
+  // the target as received, then its path normalized in place once complete
+  char *url; /* NULL if the path is invalid */
   uint32_t length_url;
-  UT_array *query_param;
+  query_t query; /* parsed on demand, see request_query_get() */
+  read_buffer_t *rbuf; /* holds the header fields, NULL if none */
+  // in the order received, see request_header()
+  header_entry_t headers[REQUEST_INLINE_HEADERS];
+  header_entry_t *more_headers; /* fields past REQUEST_INLINE_HEADERS, arena */
+  uint32_t capacity_more_headers;
+  uint32_t num_headers;     /* complete fields */
+  uint32_t length_headers;  /* bytes of header fields and values */
+  bool headers_complete;    /* the slices won't grow anymore */
 
   char *body;
   size_t length_body;
-  uint32_t default_filename_tries;
+  size_t capacity_body;
+  uint32_t default_filename_tries; /* default files looked up so far */
+  uint8_t accept_encodings; /* CONTENT_ENCODING_xxx accepted by the client */
+  uint8_t tried_encodings;  /* precompressed variants looked up so far */
+  uint8_t variant;          /* encoding of the variant being looked up */
+  fdcache_entry_t *identity; /* plain file while its variants are looked up */
+
+  response_t response;
+
+  struct request_s *prev, *next; /* for utlist, pipeline of the client */
+
+  /*
+   * Holds the URL, the query parameters, the body and the other parts of the
+   * request sized at run time, they all go at once with the request. Not
+   * cleared by create_request(), so keep it last.
+   */
+  arena_t arena;
+  char arena_block[REQUEST_ARENA_SIZE]
+      __attribute__((aligned(ARENA_ALIGN)));
 } request_t;
 
+// looking up and opening the content, a fs request is in flight
+#define REQUEST_STATE_PREPARING 0
+// response prepared, waiting for the responses before it
+#define REQUEST_STATE_READY 1
+// response being written, a write or sendfile is in flight
+#define REQUEST_STATE_SENDING 2
+// sendfile waiting for the socket to become writable again
+#define REQUEST_STATE_WAITING 3
+
 typedef struct client_s {
   uv_tcp_t handle;
+  uv_timer_t idle_timer; /* keep-alive timeout, closes the connection */
+  uv_poll_t writable;    /* socket writable watcher for sendfile */
+  uv_os_fd_t writable_fd; /* dup of the socket for writable, -1 if unused */
+  int pipe_fds[2];    /* io_uring splices the files in here, -1 if unused */
+  uint32_t pipe_size; /* capacity of the pipe */
   llhttp_t parser;
-  // Use bit 0 for in_use, bit 1 for in_ref
-  uint32_t flags : 2;
+  worker_t *worker;
+  uint32_t num_requests;
+  uint32_t num_queued;
+  uint32_t closing_handles;
+  bool paused; /* parser paused, reading stopped */
+  bool eof;    /* peer is done sending, close once the pipeline is empty */
+  bool corked; /* TCP_CORK set on the socket */
+  read_buffer_t *rbuf; /* received bytes, NULL while none are needed */
+  // bytes of rbuf fed to the parser, the others are parsed once resumed
+  uint32_t parsed;
+  // the handles until closed, and every request of the pipeline, the client
+  // is released at 0
+  uint32_t refcount;
 
-  request_t request;
-  response_t response;
+  request_t *parsing;  /* request being parsed */
+  request_t *requests; /* parsed requests, answered in this order */
 
-  struct client_s *next; /* for utlist */
+  struct client_s *prev, *next; /* for utlist, clients of the worker */
 } client_t;
 
-#define CLIENT_FLAG_IN_USE (1 << 0)
-#define CLIENT_FLAG_IN_REF (1 << 1)
-#define CLIENT_FLAG_MASK (CLIENT_FLAG_IN_USE | CLIENT_FLAG_IN_REF)
-
-// Macro to check the in_use flag
-#define CLIENT_IS_IN_USE(client) ((client)->flags & CLIENT_FLAG_IN_USE)
-// Macro to set the in_use flag
-#define CLIENT_SET_IN_USE(client) ((client)->flags |= CLIENT_FLAG_IN_USE)
-// Macro to clear the in_use flag
-#define CLIENT_CLEAR_IN_USE(client) ((client)->flags &= ~CLIENT_FLAG_IN_USE)
-// Macro to check the in_ref flag
-#define CLIENT_IS_IN_REF(client) ((client)->flags & CLIENT_FLAG_IN_REF)
-// Macro to set the in_ref flag
-#define CLIENT_SET_IN_REF(client) ((client)->flags |= CLIENT_FLAG_IN_REF)
-// Macro to clear the in_ref flag
-#define CLIENT_CLEAR_IN_REF(client) ((client)->flags &= ~CLIENT_FLAG_IN_REF)
-// Macro to check flags
-#define CLIENT_IS_FLAGS_FREE(client)                                           \
-  (((client)->flags & (CLIENT_FLAG_IN_USE | CLIENT_FLAG_IN_REF)) == 0)
-
-typedef struct mime_type_pair_s {
-  const char *ext;
-  const char *content_type;
-} mime_type_pair_t;
-
-typedef uint32_t statuscode_t;
-typedef struct {
-  statuscode_t code;
-  const char *reason_phrase;
-} http_status_code_t;
+// status codes below this have a status line rendered in advance
+#define HTTP_STATUS_MAX 600
 
-typedef struct header_entry_s {
-  char *field;
-  char *value;
-  struct header_entry_s *next;
-} header_entry_t;
+typedef struct {
+  const char *line; /* "HTTP/1.1 <code> <reason>\r\n", NULL if unknown */
+  uint32_t length;
+} status_line_t;
 
 /**
  * @brief Starts the web server.
@@ -105,6 +286,11 @@ typedef struct header_entry_s {
  * listens for incoming connections, and starts the event loop to handle client
  * requests.
  *
+ * When config->workers is not 1, one worker thread per requested loop (or per
+ * CPU core for 0) is started, each with its own uv_loop_t and its own listen
+ * socket bound with SO_REUSEPORT, so the kernel balances the accepts. The
+ * given ev_loop then only handles the signals and the shutdown.
+ *
  * @param ev_loop Pointer to a uv_loop_t structure
  * @param config Pointer to the web server configuration structure.
  *               If NULL, default configuration will be used.
@@ -113,3 +299,44 @@ typedef struct header_entry_s {
  *         occurs.
  */
 int webserver(uv_loop_t *ev_loop, webconfig_t *config);
+
+/**
+ * @brief Looks up a header field of a request.
+ *
+ * @param req  Pointer to the request.
+ * @param name Field name, compared case-insensitively.
+ * @param len  Receives the length of the value, may be NULL.
+ *
+ * @return Returns the value of the field (the last one if received several
+ *         times), not NUL terminated, or NULL if the request has none.
+ */
+const char *request_header(const request_t *req, const char *name,
+                           uint32_t *len);
+
+/**
+ * @brief Looks up a query parameter of a request, the query string gets
+ *        parsed on the first lookup.
+ *
+ * @param req  Pointer to the request.
+ * @param name Decoded parameter name, compared case-sensitively.
+ * @param len  Receives the length of the value, may be NULL.
+ *
+ * @return Returns the percent-decoded value (the first one if received
+ *         several times), not NUL terminated, or NULL if the request has
+ *         none.
+ */
+const char *request_query_get(request_t *req, const char *name,
+                              uint32_t *len);
+
+/**
+ * @brief Iterates over the query parameters of a request, repeated names
+ *        included.
+ *
+ * @param req   Pointer to the request.
+ * @param index Index of the parameter to start at, start with 0, receives
+ *              the index of the following one.
+ *
+ * @return Returns the parameter with its value percent-decoded, or NULL past
+ *         the last one.
+ */
+const query_param_t *request_query_next(request_t *req, uint32_t *index);
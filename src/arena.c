@@ -0,0 +1,92 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct arena_chunk_s {
+  arena_chunk_t *next;
+  char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+void arena_init(arena_t *arena, void *block, size_t size) {
+  memset(arena, 0, sizeof(arena_t));
+  arena->first = block;
+  arena->capacity_first = block != NULL ? size : 0;
+  arena->base = arena->first;
+  arena->capacity = arena->capacity_first;
+}
+
+/**
+ * @brief Switches to a new heap chunk with room for at least size bytes.
+ *
+ * @return Returns 0 on success, or -1 if out of memory.
+ */
+static int add_chunk(arena_t *arena, size_t size) {
+  const size_t capacity = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+  arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + capacity);
+  if (chunk == NULL) {
+    return -1;
+  }
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+  arena->base = chunk->data;
+  arena->used = 0;
+  arena->capacity = capacity;
+  return 0;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+  size = align_up(size > 0 ? size : 1);
+  if (arena->capacity - arena->used < size && add_chunk(arena, size) != 0) {
+    return NULL;
+  }
+  char *ptr = arena->base + arena->used;
+  arena->used += size;
+  arena->last = ptr;
+  return ptr;
+}
+
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t size) {
+  if (ptr == NULL) {
+    return arena_alloc(arena, size);
+  }
+  if (size <= old_size) {
+    return ptr;
+  }
+  if (ptr == arena->last) {
+    const size_t offset = arena->last - arena->base;
+    if (arena->capacity - offset >= size) {
+      arena->used = offset + align_up(size);
+      return ptr;
+    }
+  }
+  void *grown = arena_alloc(arena, size);
+  if (grown != NULL) {
+    memcpy(grown, ptr, old_size);
+  }
+  return grown;
+}
+
+char *arena_strndup(arena_t *arena, const char *s, size_t len) {
+  char *copy = arena_alloc(arena, len + 1);
+  if (copy != NULL) {
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+  }
+  return copy;
+}
+
+void arena_reset(arena_t *arena) {
+  while (arena->chunks != NULL) {
+    arena_chunk_t *chunk = arena->chunks;
+    arena->chunks = chunk->next;
+    free(chunk);
+  }
+  arena->base = arena->first;
+  arena->used = 0;
+  arena->capacity = arena->capacity_first;
+  arena->last = NULL;
+}
@@ -0,0 +1,182 @@
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#define COMPRESSOR_MIN_CAPACITY (16 * 1024)
+
+#if defined(HAVE_ZLIB) || defined(HAVE_BROTLI)
+/**
+ * @brief Makes room at the end of the output.
+ *
+ * @return Returns 0 on success, or UV_ENOMEM.
+ */
+static int reserve(compressor_t *c, size_t len) {
+  if (c->capacity - c->length_output >= len) {
+    return 0;
+  }
+  size_t capacity = c->capacity > 0 ? c->capacity : COMPRESSOR_MIN_CAPACITY;
+  while (capacity - c->length_output < len) {
+    capacity *= 2;
+  }
+  char *output = realloc(c->output, capacity);
+  if (output == NULL) {
+    return UV_ENOMEM;
+  }
+  c->output = output;
+  c->capacity = capacity;
+  return 0;
+}
+#endif
+
+#ifdef HAVE_ZLIB
+static int gzip_write(compressor_t *c, const char *data, size_t len,
+                      bool finish) {
+  z_stream *zs = (z_stream *)c->state;
+  zs->next_in = (Bytef *)data;
+  zs->avail_in = len;
+  for (;;) {
+    if (reserve(c, COMPRESSOR_MIN_CAPACITY) != 0) {
+      return UV_ENOMEM;
+    }
+    const size_t room = c->capacity - c->length_output;
+    zs->next_out = (Bytef *)c->output + c->length_output;
+    zs->avail_out = room;
+    const int r = deflate(zs, finish ? Z_FINISH : Z_NO_FLUSH);
+    c->length_output += room - zs->avail_out;
+    if (r == Z_STREAM_END) {
+      return 0;
+    }
+    if (r != Z_OK && r != Z_BUF_ERROR) {
+      return UV_EINVAL;
+    }
+    if (!finish && zs->avail_in == 0 && zs->avail_out > 0) {
+      return 0;
+    }
+  }
+}
+#endif
+
+#ifdef HAVE_BROTLI
+static int brotli_write(compressor_t *c, const char *data, size_t len,
+                        bool finish) {
+  BrotliEncoderState *state = (BrotliEncoderState *)c->state;
+  const uint8_t *next_in = (const uint8_t *)data;
+  size_t avail_in = len;
+  for (;;) {
+    if (reserve(c, COMPRESSOR_MIN_CAPACITY) != 0) {
+      return UV_ENOMEM;
+    }
+    size_t avail_out = c->capacity - c->length_output;
+    uint8_t *next_out = (uint8_t *)c->output + c->length_output;
+    if (!BrotliEncoderCompressStream(
+            state, finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS,
+            &avail_in, &next_in, &avail_out, &next_out, NULL)) {
+      return UV_EINVAL;
+    }
+    c->length_output = (char *)next_out - c->output;
+    if (finish ? BrotliEncoderIsFinished(state)
+               : avail_in == 0 && !BrotliEncoderHasMoreOutput(state)) {
+      return 0;
+    }
+  }
+}
+#endif
+
+uint8_t compressor_encodings(void) {
+  uint8_t encodings = 0;
+#ifdef HAVE_ZLIB
+  encodings |= CONTENT_ENCODING_GZIP;
+#endif
+#ifdef HAVE_BROTLI
+  encodings |= CONTENT_ENCODING_BR;
+#endif
+  return encodings;
+}
+
+int compressor_init(compressor_t *c, uint8_t encoding, int level,
+                    size_t size_hint) {
+  memset(c, 0, sizeof(compressor_t));
+  c->encoding = encoding;
+  if (level < 1) {
+    level = 1;
+  }
+#ifdef HAVE_ZLIB
+  if (encoding == CONTENT_ENCODING_GZIP) {
+    z_stream *zs = calloc(1, sizeof(z_stream));
+    if (zs == NULL) {
+      return UV_ENOMEM;
+    }
+    // 16 + window bits for the gzip wrapper
+    if (deflateInit2(zs, level > 9 ? 9 : level, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      free(zs);
+      return UV_ENOMEM;
+    }
+    c->state = zs;
+    return 0;
+  }
+#endif
+#ifdef HAVE_BROTLI
+  if (encoding == CONTENT_ENCODING_BR) {
+    BrotliEncoderState *state = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+    if (state == NULL) {
+      return UV_ENOMEM;
+    }
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, level);
+    if (size_hint > 0) {
+      BrotliEncoderSetParameter(state, BROTLI_PARAM_SIZE_HINT,
+                                size_hint > UINT32_MAX ? UINT32_MAX
+                                                       : (uint32_t)size_hint);
+    }
+    c->state = state;
+    return 0;
+  }
+#endif
+  UNUSED(size_hint);
+  return UV_ENOSYS;
+}
+
+int compressor_write(compressor_t *c, const char *data, size_t len,
+                     bool finish) {
+#ifdef HAVE_ZLIB
+  if (c->encoding == CONTENT_ENCODING_GZIP) {
+    return gzip_write(c, data, len, finish);
+  }
+#endif
+#ifdef HAVE_BROTLI
+  if (c->encoding == CONTENT_ENCODING_BR) {
+    return brotli_write(c, data, len, finish);
+  }
+#endif
+  UNUSED(c);
+  UNUSED(data);
+  UNUSED(len);
+  UNUSED(finish);
+  return UV_ENOSYS;
+}
+
+void compressor_free(compressor_t *c) {
+  if (c->state != NULL) {
+#ifdef HAVE_ZLIB
+    if (c->encoding == CONTENT_ENCODING_GZIP) {
+      deflateEnd((z_stream *)c->state);
+      free(c->state);
+    }
+#endif
+#ifdef HAVE_BROTLI
+    if (c->encoding == CONTENT_ENCODING_BR) {
+      BrotliEncoderDestroyInstance((BrotliEncoderState *)c->state);
+    }
+#endif
+    c->state = NULL;
+  }
+  free(c->output);
+  c->output = NULL;
+}
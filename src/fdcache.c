@@ -0,0 +1,233 @@
+#include "fdcache.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utlist.h>
+
+#define FDCACHE_MIN_BUCKETS 64
+#define FDCACHE_SWEEP_INTERVAL 1000
+
+static fdcache_entry_t **find_slot(fdcache_t *cache, const char *path,
+                                   size_t len, uint32_t hash) {
+  fdcache_entry_t **slot = &cache->buckets[hash & (cache->num_buckets - 1)];
+  while (*slot != NULL) {
+    const fdcache_entry_t *entry = *slot;
+    if (entry->hash == hash && entry->length_path == len &&
+        memcmp(entry->path, path, len) == 0) {
+      break;
+    }
+    slot = &(*slot)->hnext;
+  }
+  return slot;
+}
+
+static void grow_buckets(fdcache_t *cache) {
+  const uint32_t num_buckets = cache->num_buckets * 2;
+  fdcache_entry_t **buckets = calloc(num_buckets, sizeof(*buckets));
+  if (buckets == NULL) {
+    return; // keep the longer chains
+  }
+  for (uint32_t i = 0; i < cache->num_buckets; i++) {
+    fdcache_entry_t *entry = cache->buckets[i];
+    while (entry != NULL) {
+      fdcache_entry_t *next = entry->hnext;
+      const uint32_t index = entry->hash & (num_buckets - 1);
+      entry->hnext = buckets[index];
+      buckets[index] = entry;
+      entry = next;
+    }
+  }
+  free(cache->buckets);
+  cache->buckets = buckets;
+  cache->num_buckets = num_buckets;
+}
+
+static void unlink_entry(fdcache_t *cache, fdcache_entry_t **slot) {
+  fdcache_entry_t *entry = *slot;
+  *slot = entry->hnext;
+  entry->hnext = NULL;
+  DL_DELETE(cache->lru, entry);
+  entry->linked = false;
+  cache->count--;
+  fdcache_release(entry);
+}
+
+static void evict_entry(fdcache_t *cache, fdcache_entry_t *entry) {
+  unlink_entry(cache,
+               find_slot(cache, entry->path, entry->length_path, entry->hash));
+}
+
+static void on_sweep(uv_timer_t *handle) {
+  fdcache_t *cache = (fdcache_t *)handle->data;
+  const uint64_t now = uv_now(handle->loop);
+  // the least recently used entries are at the tail
+  while (cache->lru != NULL &&
+         cache->lru->prev->last_used + cache->inactive <= now) {
+    evict_entry(cache, cache->lru->prev);
+  }
+}
+
+int fdcache_init(fdcache_t *cache, uv_loop_t *loop, uint32_t max_entries,
+                 uint32_t valid, uint32_t inactive) {
+  memset(cache, 0, sizeof(fdcache_t));
+  cache->max_entries = max_entries;
+  cache->valid = valid;
+  cache->inactive = inactive;
+  if (max_entries == 0) {
+    return 0;
+  }
+  cache->num_buckets = FDCACHE_MIN_BUCKETS;
+  cache->buckets = calloc(cache->num_buckets, sizeof(*cache->buckets));
+  if (cache->buckets == NULL) {
+    return UV_ENOMEM;
+  }
+
+  if (inactive > 0) {
+    uv_timer_init(loop, &cache->timer);
+    cache->timer.data = cache;
+    // doesn't keep the loop alive on its own
+    uv_unref((uv_handle_t *)&cache->timer);
+    uv_timer_start(&cache->timer, on_sweep, FDCACHE_SWEEP_INTERVAL,
+                   FDCACHE_SWEEP_INTERVAL);
+  }
+  return 0;
+}
+
+void fdcache_stop(fdcache_t *cache) {
+  if (cache->timer.data != NULL &&
+      !uv_is_closing((uv_handle_t *)&cache->timer)) {
+    uv_timer_stop(&cache->timer);
+    uv_close((uv_handle_t *)&cache->timer, NULL);
+  }
+}
+
+void fdcache_destroy(fdcache_t *cache) {
+  for (uint32_t i = 0; i < cache->num_buckets; i++) {
+    while (cache->buckets[i] != NULL) {
+      unlink_entry(cache, &cache->buckets[i]);
+    }
+  }
+  free(cache->buckets);
+  cache->buckets = NULL;
+  cache->num_buckets = 0;
+}
+
+fdcache_entry_t *fdcache_lookup(fdcache_t *cache, const char *path, size_t len,
+                                uint64_t now, bool *stale) {
+  if (cache->buckets == NULL) {
+    return NULL;
+  }
+
+  fdcache_entry_t *entry = *find_slot(cache, path, len, hash_string(path, len));
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  // move to the front of the LRU list
+  if (cache->lru != entry) {
+    DL_DELETE(cache->lru, entry);
+    DL_PREPEND(cache->lru, entry);
+  }
+  entry->last_used = now;
+  entry->refcount++;
+  *stale = now >= entry->expire;
+  return entry;
+}
+
+fdcache_entry_t *fdcache_entry_new(const char *path, size_t len, uv_file fd,
+                                   const uv_stat_t *stat) {
+  fdcache_entry_t *entry = malloc(sizeof(fdcache_entry_t) + len + 1);
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  memset(entry, 0, sizeof(fdcache_entry_t));
+  entry->path = (char *)(entry + 1);
+  memcpy(entry->path, path, len);
+  entry->path[len] = '\0';
+  entry->length_path = len;
+  entry->hash = hash_string(path, len);
+  entry->fd = fd;
+  entry->stat = *stat;
+  entry->refcount = 1;
+  return entry;
+}
+
+void fdcache_insert(fdcache_t *cache, fdcache_entry_t *entry, uint64_t now) {
+  if (cache->buckets == NULL || entry->linked) {
+    return;
+  }
+
+  fdcache_entry_t **slot =
+      find_slot(cache, entry->path, entry->length_path, entry->hash);
+  if (*slot != NULL) {
+    unlink_entry(cache, slot);
+  }
+  if (cache->count >= cache->max_entries) {
+    evict_entry(cache, cache->lru->prev);
+  }
+
+  if (cache->count >= cache->num_buckets) {
+    grow_buckets(cache);
+  }
+  slot = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+  entry->hnext = *slot;
+  *slot = entry;
+  DL_PREPEND(cache->lru, entry);
+  entry->linked = true;
+  entry->expire = now + cache->valid;
+  entry->last_used = now;
+  entry->refcount++;
+  cache->count++;
+}
+
+bool fdcache_same_file(const fdcache_entry_t *entry, const uv_stat_t *stat) {
+  const uv_stat_t *old = &entry->stat;
+  return old->st_dev == stat->st_dev && old->st_ino == stat->st_ino &&
+         old->st_mode == stat->st_mode && old->st_size == stat->st_size &&
+         old->st_mtim.tv_sec == stat->st_mtim.tv_sec &&
+         old->st_mtim.tv_nsec == stat->st_mtim.tv_nsec;
+}
+
+void fdcache_revalidate(fdcache_t *cache, fdcache_entry_t *entry,
+                        uint64_t now) {
+  if (entry->linked) {
+    entry->expire = now + cache->valid;
+  }
+}
+
+void fdcache_remove(fdcache_t *cache, const char *path, size_t len) {
+  if (cache->buckets == NULL) {
+    return;
+  }
+  fdcache_entry_t **slot = find_slot(cache, path, len, hash_string(path, len));
+  if (*slot != NULL) {
+    unlink_entry(cache, slot);
+  }
+}
+
+void fdcache_remove_tree(fdcache_t *cache, const char *path, size_t len) {
+  for (uint32_t i = 0; i < cache->num_buckets; i++) {
+    fdcache_entry_t **slot = &cache->buckets[i];
+    while (*slot != NULL) {
+      const fdcache_entry_t *entry = *slot;
+      if (entry->length_path >= len && memcmp(entry->path, path, len) == 0 &&
+          (entry->length_path == len || entry->path[len] == '/')) {
+        unlink_entry(cache, slot);
+      } else {
+        slot = &(*slot)->hnext;
+      }
+    }
+  }
+}
+
+void fdcache_release(fdcache_entry_t *entry) {
+  if (--entry->refcount == 0) {
+    // closing a regular file doesn't block, no need for the threadpool
+    if (entry->fd >= 0) {
+      close(entry->fd);
+    }
+    free(entry);
+  }
+}
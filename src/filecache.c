@@ -0,0 +1,195 @@
+#include "filecache.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <utlist.h>
+
+#define FILECACHE_MIN_BUCKETS 64
+
+static filecache_entry_t **find_slot(filecache_t *cache, const char *key,
+                                     size_t len, uint32_t hash) {
+  filecache_entry_t **slot = &cache->buckets[hash & (cache->num_buckets - 1)];
+  while (*slot != NULL) {
+    const filecache_entry_t *entry = *slot;
+    if (entry->hash == hash && entry->length_key == len &&
+        memcmp(entry->key, key, len) == 0) {
+      break;
+    }
+    slot = &(*slot)->hnext;
+  }
+  return slot;
+}
+
+static void grow_buckets(filecache_t *cache) {
+  const uint32_t num_buckets = cache->num_buckets * 2;
+  filecache_entry_t **buckets = calloc(num_buckets, sizeof(*buckets));
+  if (buckets == NULL) {
+    return; // keep the longer chains
+  }
+  for (uint32_t i = 0; i < cache->num_buckets; i++) {
+    filecache_entry_t *entry = cache->buckets[i];
+    while (entry != NULL) {
+      filecache_entry_t *next = entry->hnext;
+      const uint32_t index = entry->hash & (num_buckets - 1);
+      entry->hnext = buckets[index];
+      buckets[index] = entry;
+      entry = next;
+    }
+  }
+  free(cache->buckets);
+  cache->buckets = buckets;
+  cache->num_buckets = num_buckets;
+}
+
+static void unlink_entry(filecache_t *cache, filecache_entry_t **slot) {
+  filecache_entry_t *entry = *slot;
+  *slot = entry->hnext;
+  entry->hnext = NULL;
+  DL_DELETE(cache->lru, entry);
+  entry->linked = false;
+  cache->count--;
+  cache->size -= entry->length_data;
+  filecache_release(entry);
+}
+
+int filecache_init(filecache_t *cache, size_t max_size, size_t max_file_size,
+                   uint32_t valid) {
+  memset(cache, 0, sizeof(filecache_t));
+  cache->max_size = max_size;
+  cache->max_file_size = max_file_size;
+  cache->valid = valid;
+  if (max_size == 0) {
+    return 0;
+  }
+  cache->num_buckets = FILECACHE_MIN_BUCKETS;
+  cache->buckets = calloc(cache->num_buckets, sizeof(*cache->buckets));
+  return cache->buckets != NULL ? 0 : -1;
+}
+
+void filecache_destroy(filecache_t *cache) {
+  for (uint32_t i = 0; i < cache->num_buckets; i++) {
+    while (cache->buckets[i] != NULL) {
+      unlink_entry(cache, &cache->buckets[i]);
+    }
+  }
+  free(cache->buckets);
+  cache->buckets = NULL;
+  cache->num_buckets = 0;
+}
+
+filecache_entry_t *filecache_lookup(filecache_t *cache, const char *key,
+                                    size_t len, uint64_t now) {
+  if (cache->buckets == NULL) {
+    return NULL;
+  }
+
+  filecache_entry_t **slot = find_slot(cache, key, len, hash_string(key, len));
+  filecache_entry_t *entry = *slot;
+  if (entry == NULL) {
+    return NULL;
+  }
+  if (now >= entry->expire) {
+    unlink_entry(cache, slot);
+    return NULL;
+  }
+
+  // move to the front of the LRU list
+  if (cache->lru != entry) {
+    DL_DELETE(cache->lru, entry);
+    DL_PREPEND(cache->lru, entry);
+  }
+  entry->refcount++;
+  return entry;
+}
+
+filecache_entry_t *filecache_entry_new(const char *key, size_t len,
+                                       const char *header, size_t length_header,
+                                       size_t length_body) {
+  const size_t length_data = length_header + 2 + length_body;
+  filecache_entry_t *entry =
+      malloc(sizeof(filecache_entry_t) + len + 1 + length_data);
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  memset(entry, 0, sizeof(filecache_entry_t));
+  entry->key = (char *)(entry + 1);
+  memcpy(entry->key, key, len);
+  entry->key[len] = '\0';
+  entry->length_key = len;
+  entry->hash = hash_string(key, len);
+
+  entry->data = entry->key + len + 1;
+  memcpy(entry->data, header, length_header);
+  memcpy(entry->data + length_header, "\r\n", 2);
+  entry->length_header = length_header;
+  entry->length_data = length_data;
+  entry->refcount = 1;
+  return entry;
+}
+
+void filecache_insert(filecache_t *cache, filecache_entry_t *entry,
+                      uint64_t now) {
+  if (cache->buckets == NULL || entry->linked ||
+      entry->length_data > cache->max_size) {
+    return;
+  }
+
+  filecache_entry_t **slot =
+      find_slot(cache, entry->key, entry->length_key, entry->hash);
+  if (*slot != NULL) {
+    unlink_entry(cache, slot);
+  }
+
+  // evict the least recently used entries
+  while (cache->lru != NULL &&
+         cache->size + entry->length_data > cache->max_size) {
+    filecache_entry_t *last = cache->lru->prev;
+    unlink_entry(cache, find_slot(cache, last->key, last->length_key,
+                                  last->hash));
+  }
+
+  if (cache->count >= cache->num_buckets) {
+    grow_buckets(cache);
+  }
+  slot = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+  entry->hnext = *slot;
+  *slot = entry;
+  DL_PREPEND(cache->lru, entry);
+  entry->linked = true;
+  entry->expire = now + cache->valid;
+  entry->refcount++;
+  cache->count++;
+  cache->size += entry->length_data;
+}
+
+void filecache_remove(filecache_t *cache, const char *key, size_t len) {
+  if (cache->buckets == NULL) {
+    return;
+  }
+  filecache_entry_t **slot = find_slot(cache, key, len, hash_string(key, len));
+  if (*slot != NULL) {
+    unlink_entry(cache, slot);
+  }
+}
+
+void filecache_remove_tree(filecache_t *cache, const char *key, size_t len) {
+  for (uint32_t i = 0; i < cache->num_buckets; i++) {
+    filecache_entry_t **slot = &cache->buckets[i];
+    while (*slot != NULL) {
+      const filecache_entry_t *entry = *slot;
+      if (entry->length_key >= len && memcmp(entry->key, key, len) == 0 &&
+          (entry->length_key == len || entry->key[len] == '/')) {
+        unlink_entry(cache, slot);
+      } else {
+        slot = &(*slot)->hnext;
+      }
+    }
+  }
+}
+
+void filecache_release(filecache_entry_t *entry) {
+  if (--entry->refcount == 0) {
+    free(entry);
+  }
+}
@@ -0,0 +1,278 @@
+#include "fswatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utlist.h>
+
+static void on_fs_event(uv_fs_event_t *handle, const char *filename,
+                        int events, int status);
+
+static void on_dir_close(uv_handle_t *handle) {
+  fswatch_dir_t *dir = (fswatch_dir_t *)handle->data;
+  free(dir);
+}
+
+static void unwatch_dir(fswatch_dir_t *dir) {
+  DL_DELETE(dir->watch->dirs, dir);
+  uv_fs_event_stop(&dir->handle);
+  uv_close((uv_handle_t *)&dir->handle, on_dir_close);
+}
+
+static bool is_below(const char *path, size_t length_path, const char *prefix,
+                     size_t len) {
+  return length_path >= len && memcmp(path, prefix, len) == 0 &&
+         (length_path == len || path[len] == '/');
+}
+
+static bool is_watched(const fswatch_t *watch, const char *path, size_t len) {
+  const fswatch_dir_t *dir;
+  DL_FOREACH(watch->dirs, dir) {
+    if (dir->length_path == len && memcmp(dir->path, path, len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Adds a handle for a directory, unless it has one already.
+ *
+ * @param watch Pointer to the watch.
+ * @param path  Path of the directory relative to the root.
+ * @param len   Length of the path.
+ * @param full  Receives the path of the directory, MAX_PATH_LENGTH bytes.
+ *
+ * @return Returns 0 on success, or a libuv error code.
+ */
+static int watch_dir(fswatch_t *watch, const char *path, size_t len,
+                     char *full) {
+  const int length_full =
+      snprintf(full, MAX_PATH_LENGTH, "%s%.*s", watch->root, (int)len, path);
+  if (length_full < 0 || length_full >= MAX_PATH_LENGTH) {
+    return UV_ENAMETOOLONG;
+  }
+  if (is_watched(watch, path, len)) {
+    return 0;
+  }
+
+  fswatch_dir_t *dir = malloc(sizeof(fswatch_dir_t) + len + 1);
+  if (dir == NULL) {
+    return UV_ENOMEM;
+  }
+  dir->watch = watch;
+  dir->path = (char *)(dir + 1);
+  memcpy(dir->path, path, len);
+  dir->path[len] = '\0';
+  dir->length_path = len;
+
+  uv_fs_event_init(watch->loop, &dir->handle);
+  dir->handle.data = dir;
+  const int r = uv_fs_event_start(&dir->handle, on_fs_event, full, 0);
+  if (r != 0) {
+    uv_close((uv_handle_t *)&dir->handle, on_dir_close);
+    return r;
+  }
+  DL_APPEND(watch->dirs, dir);
+  return 0;
+}
+
+/**
+ * @brief Makes the path of a subdirectory found by a scandir.
+ *
+ * @return Returns the length of the path, or 0 if it isn't a directory or
+ *         its path is too long.
+ */
+static size_t subdir_path(const char *path, size_t len, const uv_dirent_t *ent,
+                          char *sub) {
+  if (ent->type != UV_DIRENT_DIR) {
+    return 0;
+  }
+  const int length_sub =
+      snprintf(sub, MAX_PATH_LENGTH, "%.*s/%s", (int)len, path, ent->name);
+  if (length_sub < 0 || length_sub >= MAX_PATH_LENGTH) {
+    return 0;
+  }
+  return length_sub;
+}
+
+/**
+ * @brief Adds a handle for a directory and its subdirectories, scanned
+ *        synchronously.
+ *
+ * Symbolic links are not followed, so the tree can't loop.
+ *
+ * @param watch Pointer to the watch.
+ * @param path  Path of the directory relative to the root.
+ * @param len   Length of the path.
+ *
+ * @return Returns 0 on success, or a libuv error code.
+ */
+static int watch_tree(fswatch_t *watch, const char *path, size_t len) {
+  char full[MAX_PATH_LENGTH];
+  int r = watch_dir(watch, path, len, full);
+  if (r != 0) {
+    return r;
+  }
+
+  uv_fs_t req;
+  uv_dirent_t ent;
+  r = uv_fs_scandir(watch->loop, &req, full, 0, NULL);
+  if (r < 0) {
+    uv_fs_req_cleanup(&req);
+    return r;
+  }
+  r = 0;
+  while (uv_fs_scandir_next(&req, &ent) != UV_EOF) {
+    char sub[MAX_PATH_LENGTH];
+    const size_t length_sub = subdir_path(path, len, &ent, sub);
+    if (length_sub > 0 && (r = watch_tree(watch, sub, length_sub)) != 0) {
+      break;
+    }
+  }
+  uv_fs_req_cleanup(&req);
+  return r;
+}
+
+// a directory scanned on the threadpool, see scan_tree()
+typedef struct fswatch_scan_s {
+  uv_fs_t req;
+  fswatch_t *watch;
+  size_t length_path;
+  char path[]; /* relative to the root */
+} fswatch_scan_t;
+
+static void scan_tree(fswatch_t *watch, const char *path, size_t len);
+
+static void on_scandir(uv_fs_t *req) {
+  fswatch_scan_t *scan = (fswatch_scan_t *)req->data;
+  fswatch_t *watch = scan->watch;
+  uv_dirent_t ent;
+  // nothing to add once the watch is stopped
+  while (watch->root != NULL && req->result >= 0 &&
+         uv_fs_scandir_next(req, &ent) != UV_EOF) {
+    char sub[MAX_PATH_LENGTH];
+    const size_t length_sub =
+        subdir_path(scan->path, scan->length_path, &ent, sub);
+    if (length_sub > 0) {
+      scan_tree(watch, sub, length_sub);
+    }
+  }
+  uv_fs_req_cleanup(req);
+  free(scan);
+}
+
+/**
+ * @brief Adds a handle for a directory created while serving, its
+ *        subdirectories are scanned on the threadpool.
+ *
+ * A directory copied or moved into the tree can be large, the loop keeps
+ * serving while it is scanned. The changes below the directory until its
+ * handles are added are covered by the change of the directory itself.
+ *
+ * @param watch Pointer to the watch.
+ * @param path  Path of the directory relative to the root.
+ * @param len   Length of the path.
+ */
+static void scan_tree(fswatch_t *watch, const char *path, size_t len) {
+  char full[MAX_PATH_LENGTH];
+  if (watch_dir(watch, path, len, full) != 0) {
+    return;
+  }
+  fswatch_scan_t *scan = malloc(sizeof(fswatch_scan_t) + len + 1);
+  if (scan == NULL) {
+    return;
+  }
+  scan->watch = watch;
+  scan->length_path = len;
+  memcpy(scan->path, path, len);
+  scan->path[len] = '\0';
+  scan->req.data = scan;
+  if (uv_fs_scandir(watch->loop, &scan->req, full, 0, on_scandir) != 0) {
+    uv_fs_req_cleanup(&scan->req);
+    free(scan);
+  }
+}
+
+static void unwatch_tree(fswatch_t *watch, const char *path, size_t len) {
+  fswatch_dir_t *dir, *tmp;
+  DL_FOREACH_SAFE(watch->dirs, dir, tmp) {
+    if (is_below(dir->path, dir->length_path, path, len)) {
+      unwatch_dir(dir);
+    }
+  }
+}
+
+static void on_fs_event(uv_fs_event_t *handle, const char *filename,
+                        int events, int status) {
+  fswatch_dir_t *dir = (fswatch_dir_t *)handle->data;
+  fswatch_t *watch = dir->watch;
+  if (status < 0) {
+    return;
+  }
+
+  // the default file lookups of the directory
+  char path[MAX_PATH_LENGTH];
+  int len = snprintf(path, sizeof(path), "%s/", dir->path);
+  watch->on_change(watch, path, len - 1, false);
+  watch->on_change(watch, path, len, false);
+
+  if (filename == NULL) {
+    // the platform can't tell what changed
+    watch->on_change(watch, dir->path, dir->length_path, true);
+    return;
+  }
+
+  len = snprintf(path, sizeof(path), "%s/%s", dir->path, filename);
+  if (len < 0 || (size_t)len >= sizeof(path)) {
+    return;
+  }
+
+  if ((events & UV_RENAME) == 0) {
+    watch->on_change(watch, path, len, false);
+    return;
+  }
+
+  // created, removed or moved, might be a whole directory
+  char full[MAX_PATH_LENGTH];
+  snprintf(full, sizeof(full), "%s%s", watch->root, path);
+  uv_fs_t req;
+  const int r = uv_fs_lstat(watch->loop, &req, full, NULL);
+  const bool is_dir = r == 0 && S_ISDIR(req.statbuf.st_mode);
+  uv_fs_req_cleanup(&req);
+
+  if (r != 0) {
+    unwatch_tree(watch, path, len);
+  } else if (is_dir) {
+    scan_tree(watch, path, len);
+  }
+  watch->on_change(watch, path, len, r != 0 || is_dir);
+}
+
+int fswatch_start(fswatch_t *watch, uv_loop_t *loop, const char *root,
+                  fswatch_cb on_change) {
+  watch->loop = loop;
+  watch->dirs = NULL;
+  watch->on_change = on_change;
+  watch->length_root = strlen(root);
+  // without trailing separator, the relative paths start with one
+  while (watch->length_root > 1 && root[watch->length_root - 1] == '/') {
+    watch->length_root--;
+  }
+  watch->root = strndup(root, watch->length_root);
+  if (watch->root == NULL) {
+    return UV_ENOMEM;
+  }
+
+  const int r = watch_tree(watch, "", 0);
+  if (r != 0) {
+    fswatch_stop(watch);
+  }
+  return r;
+}
+
+void fswatch_stop(fswatch_t *watch) {
+  fswatch_dir_t *dir, *tmp;
+  DL_FOREACH_SAFE(watch->dirs, dir, tmp) { unwatch_dir(dir); }
+  free(watch->root);
+  watch->root = NULL;
+}
@@ -7,6 +7,12 @@
 #include <unistd.h>
 #include <uv.h>
 
+// compressed on the fly, the other types are mostly compressed already
+static const char *compress_types[] = {
+    "text/html",        "text/css",      "text/javascript",
+    "application/json", "image/svg+xml", "text/plain",
+    NULL};
+
 int main() {
   webconfig_t *webconfig;
   const uint32_t defaluts_files = 2;
@@ -18,6 +24,32 @@ int main() {
   webconfig->defaults[0] = "index.html";
   webconfig->defaults[1] = "index.htm";
   webconfig->cors = false;
+  webconfig->workers = 0; /* one event loop per CPU core */
+  webconfig->keepalive_timeout = 5000;
+  webconfig->keepalive_requests = 100;
+  webconfig->pipeline_depth = 16;
+  webconfig->filecache_size = 64 * 1024 * 1024;
+  webconfig->filecache_max_file = 64 * 1024;
+  // changes are picked up by the watch, the validity is only a safety net
+  webconfig->filecache_valid = 10 * 60 * 1000;
+  webconfig->fdcache_max = 1000;
+  webconfig->fdcache_valid = 60 * 1000;
+  webconfig->fdcache_inactive = 20 * 1000;
+  webconfig->sendfile_direct = true;
+  webconfig->file_engine = FILE_ENGINE_THREADPOOL;
+  webconfig->www_watch = true;
+  webconfig->precompressed = true;
+  webconfig->compress_level = 6;
+  webconfig->compress_min_size = 1024;
+  webconfig->compress_max_size = 8 * 1024 * 1024;
+  webconfig->compress_cache_size = 16 * 1024 * 1024;
+  webconfig->compress_types = compress_types;
+  // e.g. "/etc/mime.types" for the types of the system
+  webconfig->mime_types_file = NULL;
+  // e.g. "./errors" with a 404.html for a custom Not Found page
+  webconfig->error_pages_dir = NULL;
+  webconfig->read_buffer_size = 16 * 1024;
+  webconfig->read_buffer_pool = 256;
   uv_loop_t *def_loop = uv_default_loop();
   int ret = webserver(def_loop, webconfig);
   free(webconfig);
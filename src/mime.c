@@ -0,0 +1,418 @@
+#include "mime.h"
+#include "utils.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <uv.h>
+
+static const mime_type_pair_t builtin_types[] = {
+    // text
+    {"html", "text/html"},
+    {"htm", "text/html"},
+    {"shtml", "text/html"},
+    {"css", "text/css"},
+    {"js", "text/javascript"},
+    {"mjs", "text/javascript"},
+    {"txt", "text/plain"},
+    {"text", "text/plain"},
+    {"log", "text/plain"},
+    {"md", "text/markdown"},
+    {"markdown", "text/markdown"},
+    {"csv", "text/csv"},
+    {"tsv", "text/tab-separated-values"},
+    {"ics", "text/calendar"},
+    {"vtt", "text/vtt"},
+    {"xml", "text/xml"},
+    {"yaml", "application/yaml"},
+    {"yml", "application/yaml"},
+    // data and applications
+    {"json", "application/json"},
+    {"map", "application/json"},
+    {"jsonld", "application/ld+json"},
+    {"webmanifest", "application/manifest+json"},
+    {"wasm", "application/wasm"},
+    {"pdf", "application/pdf"},
+    {"rtf", "application/rtf"},
+    {"atom", "application/atom+xml"},
+    {"rss", "application/rss+xml"},
+    {"xhtml", "application/xhtml+xml"},
+    {"xsl", "application/xml"},
+    {"bin", "application/octet-stream"},
+    {"exe", "application/octet-stream"},
+    {"dll", "application/octet-stream"},
+    {"iso", "application/octet-stream"},
+    {"img", "application/octet-stream"},
+    {"dmg", "application/octet-stream"},
+    {"deb", "application/vnd.debian.binary-package"},
+    {"rpm", "application/x-rpm"},
+    {"apk", "application/vnd.android.package-archive"},
+    {"jar", "application/java-archive"},
+    {"swf", "application/x-shockwave-flash"},
+    {"epub", "application/epub+zip"},
+    {"doc", "application/msword"},
+    {"xls", "application/vnd.ms-excel"},
+    {"ppt", "application/vnd.ms-powerpoint"},
+    {"docx",
+     "application/vnd.openxmlformats-officedocument.wordprocessingml.document"},
+    {"xlsx",
+     "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"},
+    {"pptx",
+     "application/"
+     "vnd.openxmlformats-officedocument.presentationml.presentation"},
+    {"odt", "application/vnd.oasis.opendocument.text"},
+    {"ods", "application/vnd.oasis.opendocument.spreadsheet"},
+    {"odp", "application/vnd.oasis.opendocument.presentation"},
+    {"eml", "message/rfc822"},
+    // archives
+    {"zip", "application/zip"},
+    {"gz", "application/gzip"},
+    {"tgz", "application/gzip"},
+    {"bz2", "application/x-bzip2"},
+    {"xz", "application/x-xz"},
+    {"zst", "application/zstd"},
+    {"tar", "application/x-tar"},
+    {"7z", "application/x-7z-compressed"},
+    {"rar", "application/vnd.rar"},
+    // images
+    {"png", "image/png"},
+    {"apng", "image/apng"},
+    {"svg", "image/svg+xml"},
+    {"svgz", "image/svg+xml"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"jfif", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"webp", "image/webp"},
+    {"avif", "image/avif"},
+    {"heic", "image/heic"},
+    {"heif", "image/heif"},
+    {"jxl", "image/jxl"},
+    {"ico", "image/x-icon"},
+    {"cur", "image/x-icon"},
+    {"bmp", "image/bmp"},
+    {"tif", "image/tiff"},
+    {"tiff", "image/tiff"},
+    {"psd", "image/vnd.adobe.photoshop"},
+    // fonts
+    {"ttf", "font/ttf"},
+    {"otf", "font/otf"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"eot", "application/vnd.ms-fontobject"},
+    // audio
+    {"mp3", "audio/mpeg"},
+    {"ogg", "audio/ogg"},
+    {"oga", "audio/ogg"},
+    {"opus", "audio/ogg"},
+    {"wav", "audio/wav"},
+    {"flac", "audio/flac"},
+    {"aac", "audio/aac"},
+    {"m4a", "audio/mp4"},
+    {"mid", "audio/midi"},
+    {"midi", "audio/midi"},
+    {"weba", "audio/webm"},
+    // video
+    {"mp4", "video/mp4"},
+    {"m4v", "video/mp4"},
+    {"webm", "video/webm"},
+    {"ogv", "video/ogg"},
+    {"mov", "video/quicktime"},
+    {"avi", "video/x-msvideo"},
+    {"mkv", "video/x-matroska"},
+    {"wmv", "video/x-ms-wmv"},
+    {"flv", "video/x-flv"},
+    {"mpeg", "video/mpeg"},
+    {"mpg", "video/mpeg"},
+    {"3gp", "video/3gpp"},
+    {"ts", "video/mp2t"},
+    {"m3u8", "application/vnd.apple.mpegurl"},
+    {"mpd", "application/dash+xml"},
+};
+#define NUM_BUILTIN_TYPES (sizeof(builtin_types) / sizeof(builtin_types[0]))
+
+#define CONTENT_TYPE_PREFIX "Content-Type: "
+
+const mime_type_t mime_default_type = {
+    MIME_DEFAULT_TYPE, CONTENT_TYPE_PREFIX MIME_DEFAULT_TYPE "\r\n",
+    sizeof(CONTENT_TYPE_PREFIX MIME_DEFAULT_TYPE "\r\n") - 1};
+
+// extensions per bucket on average, a bucket shares one seed
+#define MIME_BUCKET_SIZE 4
+// seeds tried for a bucket before giving up
+#define MIME_MAX_SEED (1u << 20)
+
+/**
+ * @brief Hashes an extension with FNV-1a and a final mix, lowercased on the
+ *        fly.
+ */
+static uint32_t hash_ext(const char *ext, size_t len, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)tolower((unsigned char)ext[i]);
+    hash *= 16777619u;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+typedef struct mime_key_s {
+  mime_type_pair_t pair;
+  uint32_t length_ext;
+  uint32_t bucket;
+} mime_key_t;
+
+typedef struct mime_keys_s {
+  mime_key_t *keys;
+  uint32_t count;
+  uint32_t capacity;
+} mime_keys_t;
+
+/**
+ * @brief Adds a type, replaces the type of an extension added before.
+ *
+ * @return Returns 0 on success, or -1 if out of memory.
+ */
+static int add_key(mime_keys_t *keys, const char *ext, const char *type) {
+  const size_t len = strlen(ext);
+  for (uint32_t i = 0; i < keys->count; i++) {
+    if (keys->keys[i].length_ext == len &&
+        strcasecmp(keys->keys[i].pair.ext, ext) == 0) {
+      keys->keys[i].pair.content_type = type;
+      return 0;
+    }
+  }
+  if (keys->count == keys->capacity) {
+    const uint32_t capacity = keys->capacity > 0 ? keys->capacity * 2 : 256;
+    mime_key_t *grown = realloc(keys->keys, capacity * sizeof(mime_key_t));
+    if (grown == NULL) {
+      return -1;
+    }
+    keys->keys = grown;
+    keys->capacity = capacity;
+  }
+  mime_key_t *key = &keys->keys[keys->count++];
+  key->pair.ext = ext;
+  key->pair.content_type = type;
+  key->length_ext = len;
+  return 0;
+}
+
+/**
+ * @brief Reads a mime.types file, its names are NUL terminated in place.
+ *
+ * @return Returns 0 on success, or a libuv error code.
+ */
+static int load_file(mime_table_t *table, mime_keys_t *keys,
+                     const char *path) {
+  char *data;
+  size_t length;
+  const int r = read_file(path, &data, &length);
+  if (r != 0) {
+    return r;
+  }
+  table->data = data;
+
+  char *line = data;
+  while (*line != '\0') {
+    char *end = line + strcspn(line, "\n");
+    const bool last = *end == '\0';
+    *end = '\0';
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+    char *save;
+    const char *type = strtok_r(line, " \t\r", &save);
+    const char *ext;
+    while (type != NULL && (ext = strtok_r(NULL, " \t\r", &save)) != NULL) {
+      // only the last extension of a file name is looked up
+      if (strchr(ext, '.') != NULL) {
+        continue;
+      }
+      if (add_key(keys, ext, type) != 0) {
+        return UV_ENOMEM;
+      }
+    }
+    line = last ? end : end + 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Finds a seed per bucket that sends its extensions to free slots,
+ *        the largest buckets first (hash and displace).
+ *
+ * @return Returns 0 on success, UV_ENOMEM, or UV_EINVAL if no seed fits.
+ */
+static int build_hash(mime_table_t *table, mime_keys_t *keys) {
+  const uint32_t n = keys->count;
+  table->num_types = n;
+  table->num_buckets = (n + MIME_BUCKET_SIZE - 1) / MIME_BUCKET_SIZE;
+  // some room left makes the last buckets quick to place
+  table->num_slots = n + n / 4 + 1;
+  table->slots = calloc(table->num_slots, sizeof(mime_entry_t));
+  table->seeds = calloc(table->num_buckets, sizeof(uint32_t));
+  uint32_t *sizes = calloc(table->num_buckets, sizeof(uint32_t));
+  uint32_t *members = malloc(n * sizeof(uint32_t)); /* keys of a bucket */
+  uint32_t *slots = malloc(n * sizeof(uint32_t));   /* and their slots */
+  int ret = UV_ENOMEM;
+  if (table->slots == NULL || table->seeds == NULL || sizes == NULL ||
+      members == NULL || slots == NULL) {
+    goto done;
+  }
+
+  uint32_t max_size = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    mime_key_t *key = &keys->keys[i];
+    key->bucket =
+        hash_ext(key->pair.ext, key->length_ext, 0) % table->num_buckets;
+    if (++sizes[key->bucket] > max_size) {
+      max_size = sizes[key->bucket];
+    }
+  }
+
+  for (uint32_t size = max_size; size > 0; size--) {
+    for (uint32_t bucket = 0; bucket < table->num_buckets; bucket++) {
+      if (sizes[bucket] != size) {
+        continue;
+      }
+      uint32_t count = 0;
+      for (uint32_t i = 0; i < n; i++) {
+        if (keys->keys[i].bucket == bucket) {
+          members[count++] = i;
+        }
+      }
+
+      uint32_t seed, placed = 0;
+      for (seed = 1; seed < MIME_MAX_SEED && placed < count; seed++) {
+        for (placed = 0; placed < count; placed++) {
+          const mime_key_t *key = &keys->keys[members[placed]];
+          const uint32_t slot =
+              hash_ext(key->pair.ext, key->length_ext, seed) %
+              table->num_slots;
+          bool taken = table->slots[slot].ext != NULL;
+          for (uint32_t j = 0; j < placed && !taken; j++) {
+            taken = slots[j] == slot;
+          }
+          if (taken) {
+            break;
+          }
+          slots[placed] = slot;
+        }
+      }
+      if (placed < count) {
+        ret = UV_EINVAL;
+        goto done;
+      }
+      table->seeds[bucket] = seed - 1;
+      for (uint32_t i = 0; i < count; i++) {
+        const mime_type_pair_t *pair = &keys->keys[members[i]].pair;
+        table->slots[slots[i]].ext = pair->ext;
+        table->slots[slots[i]].type.content_type = pair->content_type;
+      }
+    }
+  }
+  ret = 0;
+
+done:
+  free(sizes);
+  free(members);
+  free(slots);
+  return ret;
+}
+
+/**
+ * @brief Renders the Content-Type header line of every slot.
+ *
+ * @return Returns 0 on success, or UV_ENOMEM.
+ */
+static int render_headers(mime_table_t *table) {
+  const size_t length_prefix = strlen(CONTENT_TYPE_PREFIX);
+  size_t size = 0;
+  for (uint32_t i = 0; i < table->num_slots; i++) {
+    if (table->slots[i].ext != NULL) {
+      size += length_prefix + strlen(table->slots[i].type.content_type) + 2;
+    }
+  }
+  table->headers = malloc(size + 1);
+  if (table->headers == NULL) {
+    return UV_ENOMEM;
+  }
+  char *p = table->headers;
+  for (uint32_t i = 0; i < table->num_slots; i++) {
+    mime_type_t *type = &table->slots[i].type;
+    if (table->slots[i].ext != NULL) {
+      const size_t len = strlen(type->content_type);
+      type->header = p;
+      type->length_header = length_prefix + len + 2;
+      memcpy(p, CONTENT_TYPE_PREFIX, length_prefix);
+      memcpy(p + length_prefix, type->content_type, len);
+      memcpy(p + length_prefix + len, "\r\n", 2);
+      p += type->length_header;
+    }
+  }
+  return 0;
+}
+
+int mime_table_init(mime_table_t *table, const char *path) {
+  memset(table, 0, sizeof(mime_table_t));
+  mime_keys_t keys = {NULL, 0, 0};
+  int ret = 0;
+  for (size_t i = 0; i < NUM_BUILTIN_TYPES; i++) {
+    if (add_key(&keys, builtin_types[i].ext, builtin_types[i].content_type) !=
+        0) {
+      free(keys.keys);
+      return UV_ENOMEM;
+    }
+  }
+  if (path != NULL) {
+    ret = load_file(table, &keys, path);
+    if (ret == UV_ENOMEM) {
+      free(keys.keys);
+      mime_table_free(table);
+      return ret;
+    }
+  }
+  int built = build_hash(table, &keys);
+  free(keys.keys);
+  if (built == 0) {
+    built = render_headers(table);
+  }
+  if (built != 0) {
+    mime_table_free(table);
+    return built;
+  }
+  return ret;
+}
+
+void mime_table_free(mime_table_t *table) {
+  free(table->slots);
+  free(table->seeds);
+  free(table->data);
+  free(table->headers);
+  memset(table, 0, sizeof(mime_table_t));
+}
+
+const mime_type_t *mime_table_lookup(const mime_table_t *table,
+                                     const char *path) {
+  const char *dot = strrchr(path, '.');
+  if (dot == NULL || strchr(dot, '/') != NULL || table->num_types == 0) {
+    return &mime_default_type;
+  }
+  const char *ext = dot + 1;
+  const size_t len = strlen(ext);
+  const uint32_t bucket = hash_ext(ext, len, 0) % table->num_buckets;
+  const uint32_t slot =
+      hash_ext(ext, len, table->seeds[bucket]) % table->num_slots;
+  const mime_entry_t *entry = &table->slots[slot];
+  if (entry->ext != NULL && strncasecmp(entry->ext, ext, len) == 0 &&
+      entry->ext[len] == '\0') {
+    return &entry->type;
+  }
+  return &mime_default_type;
+}
@@ -0,0 +1,96 @@
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void *alloc_aligned(size_t size) {
+  void *memory;
+  return posix_memalign(&memory, POOL_ALIGN, size) == 0 ? memory : NULL;
+}
+
+/**
+ * @brief Carves a new slab into free blocks, the first block holds the link
+ *        to the previous slab.
+ *
+ * @return Returns 0 on success, or -1 if out of memory.
+ */
+static int add_slab(pool_t *pool) {
+  char *slab = alloc_aligned(POOL_ALIGN + pool->size * pool->per_slab);
+  if (slab == NULL) {
+    return -1;
+  }
+  pool->mallocs++;
+  *(void **)slab = pool->slabs;
+  pool->slabs = slab;
+  for (uint32_t i = pool->per_slab; i-- > 0;) {
+    void *block = slab + POOL_ALIGN + i * pool->size;
+    *(void **)block = pool->free_list;
+    pool->free_list = block;
+  }
+  pool->num_free += pool->per_slab;
+  return 0;
+}
+
+void pool_init(pool_t *pool, size_t size, uint32_t max_free,
+               uint32_t per_slab) {
+  memset(pool, 0, sizeof(pool_t));
+  pool->size = (size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+  if (pool->size == 0) {
+    pool->size = POOL_ALIGN;
+  }
+  pool->max_free = max_free;
+  pool->per_slab = per_slab > 1 ? per_slab : 0;
+}
+
+void pool_destroy(pool_t *pool) {
+  if (pool->per_slab == 0) {
+    while (pool->free_list != NULL) {
+      void *block = pool->free_list;
+      pool->free_list = *(void **)block;
+      free(block);
+    }
+  }
+  while (pool->slabs != NULL) {
+    void *slab = pool->slabs;
+    pool->slabs = *(void **)slab;
+    free(slab);
+  }
+  pool->free_list = NULL;
+  pool->num_free = 0;
+}
+
+void *pool_get(pool_t *pool) {
+  if (pool->free_list == NULL && pool->per_slab > 0 && add_slab(pool) != 0) {
+    return NULL;
+  }
+  void *block = pool->free_list;
+  if (block != NULL) {
+    pool->free_list = *(void **)block;
+    pool->num_free--;
+  } else {
+    block = alloc_aligned(pool->size);
+    if (block == NULL) {
+      return NULL;
+    }
+    pool->mallocs++;
+  }
+  pool->gets++;
+  if (++pool->in_use > pool->peak_in_use) {
+    pool->peak_in_use = pool->in_use;
+  }
+  return block;
+}
+
+void pool_put(pool_t *pool, void *block) {
+  if (block == NULL) {
+    return;
+  }
+  pool->in_use--;
+  if (pool->per_slab == 0 && pool->num_free >= pool->max_free) {
+    free(block);
+    pool->frees++;
+    return;
+  }
+  *(void **)block = pool->free_list;
+  pool->free_list = block;
+  pool->num_free++;
+}
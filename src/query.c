@@ -0,0 +1,151 @@
+#include "query.h"
+#include <string.h>
+
+void query_init(query_t *query, const char *data, uint32_t length) {
+  memset(query, 0, sizeof(query_t));
+  query->data = data;
+  query->length = length;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static bool needs_decoding(const char *s, uint32_t len) {
+  return memchr(s, '%', len) != NULL || memchr(s, '+', len) != NULL;
+}
+
+/**
+ * @brief Decodes a name or value of the query into the arena, '+' stands for
+ *        a space and malformed escapes are kept as is.
+ *
+ * @return Returns 0 on success, or -1 if out of memory.
+ */
+static int decode(arena_t *arena, const char **s, uint32_t *len) {
+  const char *in = *s;
+  char *out = arena_alloc(arena, *len + 1);
+  if (out == NULL) {
+    return -1;
+  }
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < *len; i++) {
+    int high, low;
+    if (in[i] == '+') {
+      out[n++] = ' ';
+    } else if (in[i] == '%' && i + 2 < *len &&
+               (high = hex_value(in[i + 1])) >= 0 &&
+               (low = hex_value(in[i + 2])) >= 0) {
+      out[n++] = (char)(high << 4 | low);
+      i += 2;
+    } else {
+      out[n++] = in[i];
+    }
+  }
+  out[n] = '\0';
+  *s = out;
+  *len = n;
+  return 0;
+}
+
+/**
+ * @brief Splits the query into its parameters, the names get decoded.
+ *
+ * @return Returns 0 on success, or -1 if out of memory.
+ */
+static int parse(query_t *query, arena_t *arena) {
+  uint32_t count = 1;
+  for (uint32_t i = 0; i < query->length; i++) {
+    count += query->data[i] == '&';
+  }
+  query->num_params = 0;
+  query->params = arena_alloc(arena, count * sizeof(query_param_t));
+  if (query->params == NULL) {
+    return -1;
+  }
+
+  const char *p = query->data;
+  const char *end = query->data + query->length;
+  while (p < end) {
+    const char *amp = memchr(p, '&', end - p);
+    const char *token_end = amp != NULL ? amp : end;
+    if (token_end > p) {
+      query_param_t *param = &query->params[query->num_params];
+      const char *equal = memchr(p, '=', token_end - p);
+      param->name = p;
+      param->length_name = (equal != NULL ? equal : token_end) - p;
+      param->value = equal != NULL ? equal + 1 : token_end;
+      param->length_value = token_end - param->value;
+      param->decoded = !needs_decoding(param->value, param->length_value);
+      if (needs_decoding(param->name, param->length_name) &&
+          decode(arena, &param->name, &param->length_name) != 0) {
+        return -1;
+      }
+      query->num_params++;
+    }
+    p = token_end + 1;
+  }
+  query->parsed = true;
+  return 0;
+}
+
+/**
+ * @brief Gets a parameter, parses the query first if not done yet.
+ *
+ * @return Returns the parameter, or NULL past the last one or if out of
+ *         memory.
+ */
+static query_param_t *param_at(query_t *query, arena_t *arena,
+                               uint32_t index) {
+  if (!query->parsed && (query->data == NULL || parse(query, arena) != 0)) {
+    return NULL;
+  }
+  return index < query->num_params ? &query->params[index] : NULL;
+}
+
+static int decode_value(query_param_t *param, arena_t *arena) {
+  if (!param->decoded) {
+    if (decode(arena, &param->value, &param->length_value) != 0) {
+      return -1;
+    }
+    param->decoded = true;
+  }
+  return 0;
+}
+
+const query_param_t *query_next(query_t *query, arena_t *arena,
+                                uint32_t *index) {
+  query_param_t *param = param_at(query, arena, *index);
+  if (param == NULL || decode_value(param, arena) != 0) {
+    return NULL;
+  }
+  (*index)++;
+  return param;
+}
+
+const char *query_get(query_t *query, arena_t *arena, const char *name,
+                      uint32_t *len) {
+  const size_t length_name = strlen(name);
+  query_param_t *param;
+  for (uint32_t i = 0; (param = param_at(query, arena, i)) != NULL; i++) {
+    if (param->length_name == length_name &&
+        memcmp(param->name, name, length_name) == 0) {
+      if (decode_value(param, arena) != 0) {
+        return NULL;
+      }
+      if (len != NULL) {
+        *len = param->length_value;
+      }
+      return param->value;
+    }
+  }
+  return NULL;
+}
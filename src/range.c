@@ -0,0 +1,110 @@
+#include "defineds.h"
+#include "range.h"
+#include <string.h>
+#include <strings.h>
+
+static const char *skip_spaces(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  return p;
+}
+
+/**
+ * @brief Parses a decimal number.
+ *
+ * @return Returns the first character after the number, or NULL if there are
+ *         no digits or the number overflows.
+ */
+static const char *parse_number(const char *p, const char *end,
+                                uint64_t *number) {
+  const char *start = p;
+  uint64_t n = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    const uint64_t digit = *p - '0';
+    if (n > (UINT64_MAX - digit) / 10) {
+      return NULL;
+    }
+    n = n * 10 + digit;
+    p++;
+  }
+  *number = n;
+  return p > start ? p : NULL;
+}
+
+int range_parse(const char *value, size_t len, uint64_t size, range_t *ranges,
+                uint32_t max) {
+  const char *p = value;
+  const char *end = value + len;
+  if (len < 6 || strncasecmp(p, "bytes", 5) != 0) {
+    return -1;
+  }
+  p = skip_spaces(p + 5, end);
+  if (p == end || *p != '=') {
+    return -1;
+  }
+  p++;
+
+  uint32_t count = 0;
+  bool any = false;
+  while (p < end) {
+    // empty list elements are allowed
+    p = skip_spaces(p, end);
+    if (p < end && *p == ',') {
+      p++;
+      continue;
+    }
+    if (p == end) {
+      break;
+    }
+
+    uint64_t first = 0, last = UINT64_MAX;
+    bool suffix = false;
+    if (*p == '-') {
+      // the last bytes
+      suffix = true;
+      p = parse_number(p + 1, end, &last);
+    } else {
+      p = parse_number(p, end, &first);
+      if (p == NULL || p == end || *p != '-') {
+        return -1;
+      }
+      p++;
+      if (p < end && *p >= '0' && *p <= '9') {
+        p = parse_number(p, end, &last);
+      }
+    }
+    if (p == NULL) {
+      return -1;
+    }
+    p = skip_spaces(p, end);
+    if (p < end && *p != ',') {
+      return -1;
+    }
+    if (!suffix && last < first) {
+      return -1;
+    }
+    any = true;
+
+    range_t range;
+    memset(&range, 0, sizeof(range));
+    if (suffix) {
+      if (last == 0 || size == 0) {
+        continue;
+      }
+      range.start = last < size ? size - last : 0;
+      range.end = size;
+    } else {
+      if (first >= size) {
+        continue;
+      }
+      range.start = first;
+      range.end = last < size ? last + 1 : size;
+    }
+    if (count >= max) {
+      return -1;
+    }
+    ranges[count++] = range;
+  }
+  return any ? (int)count : -1;
+}
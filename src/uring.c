@@ -0,0 +1,332 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* struct statx */
+#endif
+
+#include "uring.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBURING
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#define URING_STAT 0
+#define URING_OPEN_STAT 1
+#define URING_READ 2
+#define URING_SPLICE 3
+
+// tag of the stat half of a linked stat and open, in the low bit of the
+// user data (requests are at least 2 bytes aligned)
+#define URING_TAG_STAT ((uintptr_t)1)
+
+static void statx_to_uv(const struct statx *stx, uv_stat_t *st) {
+  memset(st, 0, sizeof(uv_stat_t));
+  st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+  st->st_mode = stx->stx_mode;
+  st->st_nlink = stx->stx_nlink;
+  st->st_uid = stx->stx_uid;
+  st->st_gid = stx->stx_gid;
+  st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+  st->st_ino = stx->stx_ino;
+  st->st_size = stx->stx_size;
+  st->st_blksize = stx->stx_blksize;
+  st->st_blocks = stx->stx_blocks;
+  st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+  st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+  st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+  st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+  st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+  st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+  st->st_birthtim.tv_sec = stx->stx_btime.tv_sec;
+  st->st_birthtim.tv_nsec = stx->stx_btime.tv_nsec;
+}
+
+static int uv_result(int res) {
+  return res < 0 ? uv_translate_sys_error(-res) : res;
+}
+
+static void complete(uring_t *ring, void *user_data, int res) {
+  uring_req_t *req = (uring_req_t *)((uintptr_t)user_data & ~URING_TAG_STAT);
+  if ((uintptr_t)user_data & URING_TAG_STAT) {
+    req->stat_result = uv_result(res);
+  } else {
+    req->result = uv_result(res);
+  }
+  if (--req->pending > 0) {
+    return;
+  }
+
+  switch (req->type) {
+  case URING_STAT:
+    req->result = req->stat_result;
+    // fall through
+  case URING_OPEN_STAT:
+    if (req->stat_result == 0) {
+      statx_to_uv(&req->statx, &req->statbuf);
+    } else {
+      // the open got canceled along with the failed stat
+      req->result = req->stat_result;
+    }
+    break;
+  default:
+    break;
+  }
+  ring->inflight--;
+  req->cb(req);
+}
+
+static void reap(uring_t *ring) {
+  struct io_uring_cqe *cqe;
+  while (io_uring_peek_cqe(&ring->ring, &cqe) == 0) {
+    void *user_data = io_uring_cqe_get_data(cqe);
+    const int res = cqe->res;
+    io_uring_cqe_seen(&ring->ring, cqe);
+    complete(ring, user_data, res);
+  }
+}
+
+static void on_completion(uv_poll_t *handle, int status, int events) {
+  UNUSED(status);
+  UNUSED(events);
+  uring_t *ring = (uring_t *)handle->data;
+  uint64_t count;
+  // reset the counter, the completion queue tells how many there are
+  if (read(ring->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+    return;
+  }
+  reap(ring);
+}
+
+static void on_submit(uv_prepare_t *handle) {
+  uring_t *ring = (uring_t *)handle->data;
+  // retried on the next loop iteration if the kernel is busy
+  if (io_uring_submit(&ring->ring) >= 0) {
+    ring->unsubmitted = 0;
+    uv_prepare_stop(handle);
+  }
+}
+
+/**
+ * @brief Gets submission queue entries, submitting the queue if it is full.
+ *
+ * @param ring  Pointer to the ring.
+ * @param count Number of entries, consecutive for linked operations.
+ *
+ * @return Returns the first entry, or NULL.
+ */
+static struct io_uring_sqe *get_sqes(uring_t *ring, uint32_t count) {
+  if (io_uring_sq_space_left(&ring->ring) < count) {
+    io_uring_submit(&ring->ring);
+    ring->unsubmitted = 0;
+    if (io_uring_sq_space_left(&ring->ring) < count) {
+      return NULL;
+    }
+  }
+  return io_uring_get_sqe(&ring->ring);
+}
+
+static void queue(uring_t *ring, uring_req_t *req, uint8_t type,
+                  uint32_t count, uring_cb cb) {
+  req->ring = ring;
+  req->type = type;
+  req->cb = cb;
+  req->pending = count;
+  ring->inflight++;
+  if (ring->unsubmitted == 0) {
+    uv_prepare_start(&ring->submitter, on_submit);
+  }
+  ring->unsubmitted += count;
+}
+
+int uring_init(uring_t *ring, uv_loop_t *loop, uint32_t entries) {
+  memset(ring, 0, sizeof(uring_t));
+  int r = io_uring_queue_init(entries, &ring->ring, 0);
+  if (r < 0) {
+    // no io_uring in this kernel or not allowed (seccomp)
+    return uv_translate_sys_error(-r);
+  }
+
+  struct io_uring_probe *probe = io_uring_get_probe_ring(&ring->ring);
+  const bool supported =
+      probe != NULL && io_uring_opcode_supported(probe, IORING_OP_STATX) &&
+      io_uring_opcode_supported(probe, IORING_OP_OPENAT) &&
+      io_uring_opcode_supported(probe, IORING_OP_READ) &&
+      io_uring_opcode_supported(probe, IORING_OP_SPLICE);
+  if (probe != NULL) {
+    io_uring_free_probe(probe);
+  }
+  if (!supported) {
+    io_uring_queue_exit(&ring->ring);
+    return UV_ENOTSUP;
+  }
+
+  ring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ring->event_fd < 0) {
+    r = uv_translate_sys_error(errno);
+    io_uring_queue_exit(&ring->ring);
+    return r;
+  }
+  r = io_uring_register_eventfd(&ring->ring, ring->event_fd);
+  if (r == 0) {
+    r = uv_poll_init(loop, &ring->event_poll, ring->event_fd);
+  }
+  if (r != 0) {
+    close(ring->event_fd);
+    io_uring_queue_exit(&ring->ring);
+    return uv_result(r);
+  }
+  ring->event_poll.data = ring;
+  uv_poll_start(&ring->event_poll, UV_READABLE, on_completion);
+  uv_prepare_init(loop, &ring->submitter);
+  ring->submitter.data = ring;
+  ring->active = true;
+  return 0;
+}
+
+void uring_stop(uring_t *ring) {
+  if (!ring->active || uv_is_closing((uv_handle_t *)&ring->event_poll)) {
+    return;
+  }
+  uv_poll_stop(&ring->event_poll);
+  uv_prepare_stop(&ring->submitter);
+  uv_close((uv_handle_t *)&ring->event_poll, NULL);
+  uv_close((uv_handle_t *)&ring->submitter, NULL);
+}
+
+void uring_destroy(uring_t *ring) {
+  if (!ring->active) {
+    return;
+  }
+  io_uring_submit(&ring->ring);
+  while (ring->inflight > 0) {
+    struct io_uring_cqe *cqe;
+    if (io_uring_wait_cqe(&ring->ring, &cqe) < 0) {
+      break;
+    }
+    reap(ring);
+  }
+  io_uring_queue_exit(&ring->ring);
+  close(ring->event_fd);
+  ring->active = false;
+}
+
+int uring_stat(uring_t *ring, uring_req_t *req, const char *path,
+               uring_cb cb) {
+  // the kernel may read the path after the submission
+  req->path = strdup(path);
+  struct io_uring_sqe *sqe = req->path != NULL ? get_sqes(ring, 1) : NULL;
+  if (sqe == NULL) {
+    free(req->path);
+    req->path = NULL;
+    return UV_ENOMEM;
+  }
+  io_uring_prep_statx(sqe, AT_FDCWD, req->path, 0,
+                      STATX_BASIC_STATS | STATX_BTIME, &req->statx);
+  io_uring_sqe_set_data(sqe, (void *)((uintptr_t)req | URING_TAG_STAT));
+  queue(ring, req, URING_STAT, 1, cb);
+  return 0;
+}
+
+int uring_open_stat(uring_t *ring, uring_req_t *req, const char *path,
+                    uring_cb cb) {
+  req->path = strdup(path);
+  struct io_uring_sqe *sqe = req->path != NULL ? get_sqes(ring, 2) : NULL;
+  if (sqe == NULL) {
+    free(req->path);
+    req->path = NULL;
+    return UV_ENOMEM;
+  }
+  io_uring_prep_statx(sqe, AT_FDCWD, req->path, 0,
+                      STATX_BASIC_STATS | STATX_BTIME, &req->statx);
+  io_uring_sqe_set_data(sqe, (void *)((uintptr_t)req | URING_TAG_STAT));
+  // the open only runs if the stat succeeded
+  io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+
+  sqe = io_uring_get_sqe(&ring->ring);
+  io_uring_prep_openat(sqe, AT_FDCWD, req->path,
+                       O_RDONLY | O_NONBLOCK | O_CLOEXEC, 0);
+  io_uring_sqe_set_data(sqe, req);
+  queue(ring, req, URING_OPEN_STAT, 2, cb);
+  return 0;
+}
+
+int uring_read(uring_t *ring, uring_req_t *req, uv_file fd, char *buf,
+               size_t len, int64_t offset, uring_cb cb) {
+  struct io_uring_sqe *sqe = get_sqes(ring, 1);
+  req->path = NULL;
+  if (sqe == NULL) {
+    return UV_ENOMEM;
+  }
+  io_uring_prep_read(sqe, fd, buf, len, offset);
+  io_uring_sqe_set_data(sqe, req);
+  queue(ring, req, URING_READ, 1, cb);
+  return 0;
+}
+
+int uring_splice(uring_t *ring, uring_req_t *req, uv_file fd, int64_t offset,
+                 int pipe_fd, size_t len, uring_cb cb) {
+  struct io_uring_sqe *sqe = get_sqes(ring, 1);
+  req->path = NULL;
+  if (sqe == NULL) {
+    return UV_ENOMEM;
+  }
+  io_uring_prep_splice(sqe, fd, offset, pipe_fd, -1, len, 0);
+  io_uring_sqe_set_data(sqe, req);
+  queue(ring, req, URING_SPLICE, 1, cb);
+  return 0;
+}
+
+#else /* HAVE_LIBURING */
+
+int uring_init(uring_t *ring, uv_loop_t *loop, uint32_t entries) {
+  UNUSED(loop);
+  UNUSED(entries);
+  memset(ring, 0, sizeof(uring_t));
+  return UV_ENOSYS;
+}
+
+void uring_stop(uring_t *ring) { UNUSED(ring); }
+
+void uring_destroy(uring_t *ring) { UNUSED(ring); }
+
+int uring_stat(uring_t *ring, uring_req_t *req, const char *path,
+               uring_cb cb) {
+  UNUSED(ring);
+  UNUSED(req);
+  UNUSED(path);
+  UNUSED(cb);
+  return UV_ENOSYS;
+}
+
+int uring_open_stat(uring_t *ring, uring_req_t *req, const char *path,
+                    uring_cb cb) {
+  return uring_stat(ring, req, path, cb);
+}
+
+int uring_read(uring_t *ring, uring_req_t *req, uv_file fd, char *buf,
+               size_t len, int64_t offset, uring_cb cb) {
+  UNUSED(fd);
+  UNUSED(buf);
+  UNUSED(len);
+  UNUSED(offset);
+  return uring_stat(ring, req, NULL, cb);
+}
+
+int uring_splice(uring_t *ring, uring_req_t *req, uv_file fd, int64_t offset,
+                 int pipe_fd, size_t len, uring_cb cb) {
+  UNUSED(fd);
+  UNUSED(offset);
+  UNUSED(pipe_fd);
+  UNUSED(len);
+  return uring_stat(ring, req, NULL, cb);
+}
+
+#endif /* HAVE_LIBURING */
+
+void uring_req_cleanup(uring_req_t *req) {
+  free(req->path);
+  req->path = NULL;
+}
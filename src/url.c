@@ -0,0 +1,144 @@
+#include "url.h"
+#include "defineds.h"
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// bytes that end a run copied as is: escapes, separators and NUL
+static const bool special[256] = {
+    ['\0'] = true, ['%'] = true, ['/'] = true, ['\\'] = true};
+
+/**
+ * @brief Skips the bytes copied as is, 16 or 32 at a time if the target has
+ *        SSE2 or AVX2.
+ *
+ * @return Returns the first special byte, or end.
+ */
+static const char *scan_plain(const char *p, const char *end) {
+#if defined(__AVX2__)
+  const __m256i percent = _mm256_set1_epi8('%');
+  const __m256i slash = _mm256_set1_epi8('/');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i zero = _mm256_setzero_si256();
+  while (end - p >= 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    const __m256i hits = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, percent),
+                        _mm256_cmpeq_epi8(v, slash)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, backslash),
+                        _mm256_cmpeq_epi8(v, zero)));
+    const uint32_t mask = (uint32_t)_mm256_movemask_epi8(hits);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 32;
+  }
+#elif defined(__SSE2__)
+  const __m128i percent = _mm_set1_epi8('%');
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i zero = _mm_setzero_si128();
+  while (end - p >= 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)p);
+    const __m128i hits =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, percent),
+                                  _mm_cmpeq_epi8(v, slash)),
+                     _mm_or_si128(_mm_cmpeq_epi8(v, backslash),
+                                  _mm_cmpeq_epi8(v, zero)));
+    const uint32_t mask = (uint32_t)_mm_movemask_epi8(hits);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p < end && !special[(unsigned char)*p]) {
+    p++;
+  }
+  return p;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static bool is_separator(char c) { return c == '/' || c == '\\'; }
+
+int url_normalize_path(char *path, size_t len) {
+  if (len == 0 || len > INT_MAX || !is_separator(path[0])) {
+    return -1;
+  }
+  // the output never gets ahead of the input, every byte written stands for
+  // at least one byte read
+  const char *r = path;
+  const char *end = path + len;
+  char *w = path;
+  while (r < end) {
+    if (is_separator(*r)) {
+      if (w == path || w[-1] != '/') {
+        *w++ = '/';
+      }
+      r++;
+      continue;
+    }
+
+    char *segment = w;
+    while (r < end && !is_separator(*r)) {
+      const char *plain = scan_plain(r, end);
+      if (plain > r) {
+        const size_t n = plain - r;
+        if (w != r) {
+          memmove(w, r, n);
+        }
+        w += n;
+        r = plain;
+        continue;
+      }
+      if (*r != '%' || end - r < 3) {
+        return -1;
+      }
+      const int high = hex_value(r[1]);
+      const int low = hex_value(r[2]);
+      if (high < 0 || low < 0) {
+        return -1;
+      }
+      const char c = (char)(high << 4 | low);
+      if (c == '\0' || is_separator(c)) {
+        return -1;
+      }
+      *w++ = c;
+      r += 3;
+    }
+
+    const size_t n = w - segment;
+    if (n == 1 && segment[0] == '.') {
+      w = segment;
+    } else if (n == 2 && segment[0] == '.' && segment[1] == '.') {
+      // back to the slash ending the parent, the root slash stays
+      w = segment - 1;
+      while (w > path && w[-1] != '/') {
+        w--;
+      }
+      if (w == path) {
+        w = path + 1;
+      }
+    }
+  }
+  *w = '\0';
+  return (int)(w - path);
+}
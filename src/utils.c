@@ -1,50 +1,43 @@
 
 #include "defineds.h"
+#include "utils.h"
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /**
- * @brief Validates and normalizes a file path.
+ * @brief Normalizes a file path into a buffer of the caller.
  *
- * This function validates and normalizes the provided file path, ensuring that
- * it follows standard conventions. The resulting path is returned as a newly
- * allocated string. The caller is responsible for freeing the memory allocated
- * for the output path.
+ * The separators get folded into single slashes, "." and ".." segments get
+ * resolved without ever going above the root.
  *
- * @param path The input file path to be validated and normalized.
+ * @param path   The input file path, not necessarily NUL terminated.
+ * @param len    Length of the input path.
+ * @param output Receives the NUL terminated path, len + 2 bytes are always
+ *               enough.
+ * @param size   Bytes of output.
  *
- * @return Returns a pointer to the validated and normalized file path, or NULL
- *         if an error occurs during memory allocation or if the input path is
- *         invalid.
+ * @return Returns the length of the normalized path, or -1 if it doesn't fit
+ *         in output.
  */
-char *validate_and_normalize_path(const char *path) {
-  // Allocate memory for the output path using calloc for zero-initialization
-  char *output =
-      calloc(MAX_PATH_LENGTH + 1, sizeof(char)); // +1 for null terminator
-  if (!output) {
-    return NULL; // Handle allocation failure
-  }
-
-  const int len = strlen(path);
-  int out_len = 0; // Track output path length
-
-  if (path[0] != '\\' || path[0] != '/') {
-    output[0] = '/';
-    out_len++;
+int normalize_path(const char *path, size_t len, char *output, size_t size) {
+  if (size < 2) {
+    return -1;
   }
+  const size_t max_len = size - 1; // room for the null terminator
+  size_t out_len = 0;              // Track output path length
+  output[out_len++] = '/';
 
-  for (int i = 0; i < len; i++) {
+  for (size_t i = 0; i < len; i++) {
     if (path[i] == '/' || path[i] == '\\') {
       // Handle slashes
       if (out_len == 0 || output[out_len - 1] != '/') {
         // Add a single separator only if not empty or preceded by another
-        if (out_len < MAX_PATH_LENGTH) {
-          output[out_len++] = '/';
-        } else {
-          // Handle overflow: return NULL or set an error flag
-          free(output);
-          return NULL;
+        if (out_len >= max_len) {
+          return -1;
         }
+        output[out_len++] = '/';
       } else if (out_len != 0 && (output[out_len - 1] == '/') ||
                  (output[out_len - 1] == '\\')) {
         out_len = 0;
@@ -53,7 +46,9 @@ char *validate_and_normalize_path(const char *path) {
     } else if (path[i] == '.') {
       if ((i + 1 < len) && path[i + 1] == '.') {
         // Handle ".."
-        out_len--;
+        if (out_len > 0) {
+          out_len--;
+        }
         // Remove previous elements until a separator or beginning (excluding
         // root)
         while (out_len > 1 && output[out_len - 1] != '/') {
@@ -69,32 +64,285 @@ char *validate_and_normalize_path(const char *path) {
         i++;
       } else {
         // Handle file extension or single "."
-        if (out_len < MAX_PATH_LENGTH) {
-          output[out_len++] = path[i];
-        } else {
-          // Handle overflow
-          free(output);
-          return NULL;
+        if (out_len >= max_len) {
+          return -1;
         }
+        output[out_len++] = path[i];
       }
     } else {
       // Add other characters
-      if (out_len < MAX_PATH_LENGTH) {
-        output[out_len++] = path[i];
-      } else {
-        // Handle overflow
-        free(output);
-        return NULL;
+      if (out_len >= max_len) {
+        return -1;
       }
+      output[out_len++] = path[i];
     }
   }
 
-  // Optionally: null-terminate the output path explicitly
   output[out_len] = '\0';
+  return (int)out_len;
+}
 
+/**
+ * @brief Validates and normalizes a file path.
+ *
+ * The resulting path is returned as a newly allocated string, see
+ * normalize_path(). The caller is responsible for freeing the memory
+ * allocated for the output path.
+ *
+ * @param path The input file path to be validated and normalized.
+ *
+ * @return Returns a pointer to the validated and normalized file path, or NULL
+ *         if an error occurs during memory allocation or if the input path is
+ *         invalid.
+ */
+char *validate_and_normalize_path(const char *path) {
+  // Allocate memory for the output path using calloc for zero-initialization
+  char *output =
+      calloc(MAX_PATH_LENGTH + 1, sizeof(char)); // +1 for null terminator
+  if (!output) {
+    return NULL; // Handle allocation failure
+  }
+  if (normalize_path(path, strlen(path), output, MAX_PATH_LENGTH + 1) < 0) {
+    free(output);
+    return NULL;
+  }
   return output;
 }
 
+/**
+ * @brief Writes an unsigned integer in decimal, two digits at a time.
+ *
+ * @param value The integer.
+ * @param buf   Receives the digits, UINT64_DIGITS bytes, not NUL terminated.
+ *
+ * @return Returns the number of digits.
+ */
+size_t format_uint64(uint64_t value, char *buf) {
+  static const char pairs[201] = "00010203040506070809"
+                                 "10111213141516171819"
+                                 "20212223242526272829"
+                                 "30313233343536373839"
+                                 "40414243444546474849"
+                                 "50515253545556575859"
+                                 "60616263646566676869"
+                                 "70717273747576777879"
+                                 "80818283848586878889"
+                                 "90919293949596979899";
+  char digits[UINT64_DIGITS];
+  char *p = digits + UINT64_DIGITS;
+  while (value >= 100) {
+    const unsigned pair = (unsigned)(value % 100) * 2;
+    value /= 100;
+    *--p = pairs[pair + 1];
+    *--p = pairs[pair];
+  }
+  if (value >= 10) {
+    *--p = pairs[value * 2 + 1];
+    *--p = pairs[value * 2];
+  } else {
+    *--p = (char)('0' + value);
+  }
+  const size_t len = digits + UINT64_DIGITS - p;
+  memcpy(buf, p, len);
+  return len;
+}
+
+/**
+ * @brief Hashes a string with FNV-1a, for the hash tables of the caches.
+ *
+ * @param str The string, not necessarily NUL terminated.
+ * @param len Length of the string.
+ *
+ * @return Returns the 32 bits hash.
+ */
+uint32_t hash_string(const char *str, size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static const char *const day_names[] = {"Sun", "Mon", "Tue", "Wed",
+                                        "Thu", "Fri", "Sat"};
+static const char *const month_names[] = {"Jan", "Feb", "Mar", "Apr",
+                                          "May", "Jun", "Jul", "Aug",
+                                          "Sep", "Oct", "Nov", "Dec"};
+
+/**
+ * @brief Formats a time as an HTTP-date (IMF-fixdate).
+ *
+ * @param t   Seconds since the epoch.
+ * @param buf Receives "Sun, 06 Nov 1994 08:49:37 GMT", HTTP_DATE_SIZE bytes.
+ *
+ * @return Returns the length of the date.
+ */
+size_t http_date_format(time_t t, char *buf) {
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  return snprintf(buf, HTTP_DATE_SIZE, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                  day_names[tm.tm_wday], tm.tm_mday, month_names[tm.tm_mon],
+                  tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+/**
+ * @brief Empties a cache of formatted dates.
+ */
+void http_date_cache_init(http_date_cache_t *cache) {
+  memset(cache, 0, sizeof(http_date_cache_t));
+}
+
+/**
+ * @brief Formats a time as an HTTP-date, unless the cache has it already.
+ *
+ * The cache is direct-mapped by the time, a date formatted before gets
+ * replaced by another time of the same slot.
+ *
+ * @param cache Pointer to the cache.
+ * @param t     Seconds since the epoch.
+ *
+ * @return Returns the date, valid until the cache formats another time of
+ *         its slot.
+ */
+const char *http_date_cached(http_date_cache_t *cache, time_t t) {
+  const uint32_t slot = (uint64_t)t % HTTP_DATE_CACHE_SIZE;
+  char *date = cache->dates[slot];
+  if (cache->times[slot] != t || date[0] == '\0') {
+    http_date_format(t, date);
+    cache->times[slot] = t;
+  }
+  return date;
+}
+
+static int parse_month(const char *name) {
+  for (int i = 0; i < 12; i++) {
+    if (strncmp(name, month_names[i], 3) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// days since the epoch of a date of the proleptic Gregorian calendar
+static int64_t days_from_civil(int64_t year, int month, int day) {
+  year -= month <= 2;
+  const int64_t era = (year >= 0 ? year : year - 399) / 400;
+  const int64_t yoe = year - era * 400;
+  const int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static int days_in_month(int year, int month) {
+  static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  const bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+  return days[month] + (month == 1 && leap);
+}
+
+/**
+ * @brief Parses an HTTP-date.
+ *
+ * Accepts the IMF-fixdate and the obsolete RFC 850 and asctime formats, as
+ * required from recipients by RFC 9110.
+ *
+ * @param str The date, not necessarily NUL terminated.
+ * @param len Length of the date.
+ * @param t   Receives the seconds since the epoch.
+ *
+ * @return Returns true if the date is valid.
+ */
+bool http_date_parse(const char *str, size_t len, time_t *t) {
+  char date[64];
+  char month[4];
+  int day, year, hour, min, sec, n = 0;
+  if (len >= sizeof(date)) {
+    return false;
+  }
+  memcpy(date, str, len);
+  date[len] = '\0';
+
+  const char *comma = strchr(date, ',');
+  if (comma != NULL && comma - date == 3) {
+    // Sun, 06 Nov 1994 08:49:37 GMT
+    if (sscanf(comma + 1, " %2d %3s %4d %2d:%2d:%2d GMT%n", &day, month,
+               &year, &hour, &min, &sec, &n) != 6) {
+      return false;
+    }
+  } else if (comma != NULL) {
+    // Sunday, 06-Nov-94 08:49:37 GMT
+    if (sscanf(comma + 1, " %2d-%3s-%2d %2d:%2d:%2d GMT%n", &day, month,
+               &year, &hour, &min, &sec, &n) != 6 ||
+        year < 0) {
+      return false;
+    }
+    // two digits years more than 50 years in the future are in the past
+    year += year < 70 ? 2000 : 1900;
+  } else {
+    // Sun Nov  6 08:49:37 1994
+    if (sscanf(date, "%*3s %3s %2d %2d:%2d:%2d %4d%n", month, &day, &hour,
+               &min, &sec, &year, &n) != 6) {
+      return false;
+    }
+  }
+  const int mon = parse_month(month);
+  if (n == 0 || (size_t)(n + (comma != NULL ? comma + 1 - date : 0)) != len ||
+      mon < 0 || year < 0 || day < 1 || day > days_in_month(year, mon) ||
+      hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 60) {
+    return false;
+  }
+
+  *t = (time_t)(days_from_civil(year, mon + 1, day) * 86400 + hour * 3600 +
+                min * 60 + sec);
+  return true;
+}
+
+/**
+ * @brief Reads a whole file into memory, at startup.
+ *
+ * @param path   The file.
+ * @param data   Receives the contents, NUL terminated, to be freed.
+ * @param length Receives the length of the contents.
+ *
+ * @return Returns 0 on success, or a negated errno (the libuv error code on
+ *         unix, utils.c doesn't link libuv).
+ */
+int read_file(const char *path, char **data, size_t *length) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return -errno;
+  }
+  size_t len = 0, capacity = 0;
+  char *buf = NULL;
+  for (;;) {
+    if (capacity - len < 4096) {
+      capacity = capacity > 0 ? capacity * 2 : 16 * 1024;
+      char *grown = realloc(buf, capacity + 1);
+      if (grown == NULL) {
+        free(buf);
+        fclose(file);
+        return -ENOMEM;
+      }
+      buf = grown;
+    }
+    const size_t n = fread(buf + len, 1, capacity - len, file);
+    if (n == 0) {
+      break;
+    }
+    len += n;
+  }
+  const int error = ferror(file);
+  fclose(file);
+  if (error) {
+    free(buf);
+    return -EIO;
+  }
+  buf[len] = '\0';
+  *data = buf;
+  *length = len;
+  return 0;
+}
+
 #if 0
 
 int main() {
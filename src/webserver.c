@@ -1,33 +1,59 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* pipe2(), splice() */
+#endif
 
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#endif
 
 /* include libuv & llhttp */
 #include "defineds.h"
+#include "url.h"
 #include "utils.h"
 #include "webserver.h"
-
-static void get_param_cleanup(get_param_t *param) {
-  free(param->name);
-  free(param->value);
-}
-
-static UT_icd get_params_icd = {sizeof(get_param_t), NULL, NULL,
-                                (void (*)(void *))get_param_cleanup};
-
-static const char *res404content = "<!DOCTYPE html>"
-                                   "<html>"
-                                   "<header>"
-                                   "<title>MingleJet</title>"
-                                   "</header>"
-                                   "<body>"
-                                   "<H1>Not Found</H1>"
-                                   "</body>"
-                                   "</html>";
-
-static const char *res500content =
+#include <stddef.h>
+
+static const char res400content[] = "<!DOCTYPE html>"
+                                    "<html>"
+                                    "<header>"
+                                    "<title>MingleJet</title>"
+                                    "</header>"
+                                    "<body>"
+                                    "<H1>Bad Request</H1>"
+                                    "</body>"
+                                    "</html>";
+
+static const char res401content[] = "<!DOCTYPE html>"
+                                    "<html>"
+                                    "<header>"
+                                    "<title>MingleJet</title>"
+                                    "</header>"
+                                    "<body>"
+                                    "<H1>Unauthorized</H1>"
+                                    "</body>"
+                                    "</html>";
+
+static const char res404content[] = "<!DOCTYPE html>"
+                                    "<html>"
+                                    "<header>"
+                                    "<title>MingleJet</title>"
+                                    "</header>"
+                                    "<body>"
+                                    "<H1>Not Found</H1>"
+                                    "</body>"
+                                    "</html>";
+
+static const char res500content[] =
     "<!DOCTYPE html>"
     "<html>"
     "<header>"
@@ -40,610 +66,2498 @@ static const char *res500content =
     "</body>"
     "</html>";
 
-static const char *response401 = "HTTP/1.1 401 Unauthorized\r\n"
-                                 "Location: %s\r\n"
-                                 "Content-Length: 0\r\n"
-                                 "\r\n";
-
-static mime_type_pair_t mime_types[] = {
-    {".html", "text/html"},
-    {".htm", "text/html"},
-    {".css", "text/css"},
-    {".js", "text/javascript"},
-    {".mjs", "text/javascript"},
-    {".json", "application/json"},
-    {".txt", "text/plain"},
-    {".png", "image/png"},
-    {".svg", "image/svg+xml"},
-    {".jpg", "image/jpeg"},
-    {".jpeg", "image/jpeg"},
-    {".gif", "image/gif"},
-    {".ico", "image/x-icon"},
-    {".ttf", "font/ttf"},
-    {".woff", "font/woff"},
-    {".woff2", "font/woff2"},
-    {".pdf", "application/pdf"},
-    {".mp3", "audio/mpeg"},
-    {".ogg", "audio/ogg"},
-    {".wav", "audio/wav"},
-    // { ".mp4", "video/mp4" },
-    // { ".mov", "video/quicktime" },
-    // { ".avi", "video/x-msvideo" },
-    {".zip", "application/zip"},
-    {".gz", "application/gzip"},
-    {".rar", "application/vnd.rar"},
-    // { ".doc", "application/msword" },
-    // { ".docx",
-    // "application/vnd.openxmlformats-officedocument.wordprocessingml.document"
-    // }, { ".xlsx",
-    // "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet" }, {
-    // ".pptx",
-    // "application/vnd.openxmlformats-officedocument.presentationml.presentation"
-    // }, { ".eml", "message/rfc822" },
-    {".bmp", "image/bmp"},
-    {".tiff", "image/tiff"},
-    {".XXXYYY", "application/octet-stream"},
+// the statuses with an error page, in the order of webserver_t.error_pages
+static const struct {
+  llhttp_status_t status;
+  const char *content; /* built-in page */
+  uint32_t length;
+} error_page_statuses[NUM_ERROR_PAGES] = {
+    {HTTP_STATUS_BAD_REQUEST, res400content, sizeof(res400content) - 1},
+    {HTTP_STATUS_UNAUTHORIZED, res401content, sizeof(res401content) - 1},
+    {HTTP_STATUS_NOT_FOUND, res404content, sizeof(res404content) - 1},
+    {HTTP_STATUS_INTERNAL_SERVER_ERROR, res500content,
+     sizeof(res500content) - 1},
 };
 
-/* http status codes */
-static const http_status_code_t status1xx_codes[] = {
-    // Informational responses
-    {100, "Continue"},
-    {101, "Switching Protocols"},
-    {102, "Processing"},
-    {103, "Early Hints"},
-};
-static const int num_status1xx_codes =
-    sizeof(status1xx_codes) / sizeof(http_status_code_t);
+typedef struct content_encoding_s {
+  uint8_t bit; /* CONTENT_ENCODING_xxx */
+  const char *name;
+  const char *suffix; /* of the precompressed file */
+} content_encoding_t;
 
-static const http_status_code_t status2xx_codes[] = {
-    // Successful responses
-    {200, "OK"},
-    {201, "Created"},
-    {202, "Accepted"},
-    {203, "Non-Authoritative Information"},
-    {204, "No Content"},
-    {205, "Reset Content"},
-    {206, "Partial Content"},
-    {207, "Multi-Status (WebDAV)"},
-    {208, "Already Reported (WebDAV)"},
-    {226, "IM Used"},
+// in the order of preference
+static const content_encoding_t content_encodings[] = {
+    {CONTENT_ENCODING_BR, "br", ".br"},
+    {CONTENT_ENCODING_GZIP, "gzip", ".gz"},
 };
-static const int num_status2xx_codes =
-    sizeof(status2xx_codes) / sizeof(http_status_code_t);
+static const int num_content_encodings =
+    sizeof(content_encodings) / sizeof(content_encoding_t);
 
-static const http_status_code_t status3xx_codes[] = {
-    // Redirection messages
-    {300, "Multiple Choices"},
-    {301, "Moved Permanently"},
-    {302, "Found"},
-    {303, "See Other"},
-    {304, "Not Modified"},
-    {305, "Use Proxy"},
-    {306, "(Unused)"},
-    {307, "Temporary Redirect"},
-    {308, "Permanent Redirect"},
-};
-static const int num_status3xx_codes =
-    sizeof(status3xx_codes) / sizeof(http_status_code_t);
+/* http status codes, the status lines rendered once for all */
+#define STATUS_LINE(code, reason)                                              \
+  { "HTTP/1.1 " #code " " reason "\r\n",                                      \
+    sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1 }
 
-static const http_status_code_t status4xx_codes[] = {
+static const status_line_t status_lines[HTTP_STATUS_MAX] = {
+    // Informational responses
+    [100] = STATUS_LINE(100, "Continue"),
+    [101] = STATUS_LINE(101, "Switching Protocols"),
+    [102] = STATUS_LINE(102, "Processing"),
+    [103] = STATUS_LINE(103, "Early Hints"),
+    // Successful responses
+    [200] = STATUS_LINE(200, "OK"),
+    [201] = STATUS_LINE(201, "Created"),
+    [202] = STATUS_LINE(202, "Accepted"),
+    [203] = STATUS_LINE(203, "Non-Authoritative Information"),
+    [204] = STATUS_LINE(204, "No Content"),
+    [205] = STATUS_LINE(205, "Reset Content"),
+    [206] = STATUS_LINE(206, "Partial Content"),
+    [207] = STATUS_LINE(207, "Multi-Status (WebDAV)"),
+    [208] = STATUS_LINE(208, "Already Reported (WebDAV)"),
+    [226] = STATUS_LINE(226, "IM Used"),
+    // Redirection messages
+    [300] = STATUS_LINE(300, "Multiple Choices"),
+    [301] = STATUS_LINE(301, "Moved Permanently"),
+    [302] = STATUS_LINE(302, "Found"),
+    [303] = STATUS_LINE(303, "See Other"),
+    [304] = STATUS_LINE(304, "Not Modified"),
+    [305] = STATUS_LINE(305, "Use Proxy"),
+    [306] = STATUS_LINE(306, "(Unused)"),
+    [307] = STATUS_LINE(307, "Temporary Redirect"),
+    [308] = STATUS_LINE(308, "Permanent Redirect"),
     // Client error responses
-    {400, "Bad Request"},
-    {401, "Unauthorized"},
-    {402, "Payment Required"},
-    {403, "Forbidden"},
-    {404, "Not Found"},
-    {405, "Method Not Allowed"},
-    {406, "Not Acceptable"},
-    {407, "Proxy Authentication Required"},
-    {408, "Request Timeout"},
-    {409, "Conflict"},
-    {410, "Gone"},
-    {411, "Length Required"},
-    {412, "Precondition Failed"},
-    {413, "Payload Too Large"},
-    {414, "URI Too Long"},
-    {415, "Unsupported Media Type"},
-    {416, "Range Not Satisfiable"},
-    {417, "Expectation Failed"},
-    {418, "I'm a teapot"},
-    {419, "Authentication Timeout"},
-    {421, "Misdirected Request"},
-    {422, "Unprocessable Entity"},
-    {423, "Locked"},
-    {424, "Failed Dependency"},
-    {425, "Unordered Collection"},
-    {426, "Upgrade Required"},
-    {428, "Precondition Required"},
-    {429, "Too Many Requests"},
-    {431, "Request Header Fields Too Large"},
-    {440, "Login Timeout"},
-    {444, "No Response"},
-    {450, "Blocked by Windows Parental Controls"},
-    {451, "Unavailable For Legal Reasons"},
-    {452, "Request Header Fields Too Large"},
-    {494, "Request Header Timeout"},
-    {495, "Cert Error"},
-    {496, "Client Closed Request"},
-    {497, "HTTP Request Sent To HTTPS Port"},
-    {499, "Client Closed Request"},
+    [400] = STATUS_LINE(400, "Bad Request"),
+    [401] = STATUS_LINE(401, "Unauthorized"),
+    [402] = STATUS_LINE(402, "Payment Required"),
+    [403] = STATUS_LINE(403, "Forbidden"),
+    [404] = STATUS_LINE(404, "Not Found"),
+    [405] = STATUS_LINE(405, "Method Not Allowed"),
+    [406] = STATUS_LINE(406, "Not Acceptable"),
+    [407] = STATUS_LINE(407, "Proxy Authentication Required"),
+    [408] = STATUS_LINE(408, "Request Timeout"),
+    [409] = STATUS_LINE(409, "Conflict"),
+    [410] = STATUS_LINE(410, "Gone"),
+    [411] = STATUS_LINE(411, "Length Required"),
+    [412] = STATUS_LINE(412, "Precondition Failed"),
+    [413] = STATUS_LINE(413, "Payload Too Large"),
+    [414] = STATUS_LINE(414, "URI Too Long"),
+    [415] = STATUS_LINE(415, "Unsupported Media Type"),
+    [416] = STATUS_LINE(416, "Range Not Satisfiable"),
+    [417] = STATUS_LINE(417, "Expectation Failed"),
+    [418] = STATUS_LINE(418, "I'm a teapot"),
+    [419] = STATUS_LINE(419, "Authentication Timeout"),
+    [421] = STATUS_LINE(421, "Misdirected Request"),
+    [422] = STATUS_LINE(422, "Unprocessable Entity"),
+    [423] = STATUS_LINE(423, "Locked"),
+    [424] = STATUS_LINE(424, "Failed Dependency"),
+    [425] = STATUS_LINE(425, "Unordered Collection"),
+    [426] = STATUS_LINE(426, "Upgrade Required"),
+    [428] = STATUS_LINE(428, "Precondition Required"),
+    [429] = STATUS_LINE(429, "Too Many Requests"),
+    [431] = STATUS_LINE(431, "Request Header Fields Too Large"),
+    [440] = STATUS_LINE(440, "Login Timeout"),
+    [444] = STATUS_LINE(444, "No Response"),
+    [450] = STATUS_LINE(450, "Blocked by Windows Parental Controls"),
+    [451] = STATUS_LINE(451, "Unavailable For Legal Reasons"),
+    [452] = STATUS_LINE(452, "Request Header Fields Too Large"),
+    [494] = STATUS_LINE(494, "Request Header Timeout"),
+    [495] = STATUS_LINE(495, "Cert Error"),
+    [496] = STATUS_LINE(496, "Client Closed Request"),
+    [497] = STATUS_LINE(497, "HTTP Request Sent To HTTPS Port"),
+    [499] = STATUS_LINE(499, "Client Closed Request"),
+    // Server error responses
+    [500] = STATUS_LINE(500, "Internal Server Error"),
+    [501] = STATUS_LINE(501, "Not Implemented"),
+    [502] = STATUS_LINE(502, "Bad Gateway"),
+    [503] = STATUS_LINE(503, "Service Unavailable"),
+    [504] = STATUS_LINE(504, "Gateway Timeout"),
+    [505] = STATUS_LINE(505, "HTTP Version Not Supported"),
+    [506] = STATUS_LINE(506, "Variant Also Negotiates"),
+    [507] = STATUS_LINE(507, "Insufficient Storage"),
+    [508] = STATUS_LINE(508, "Loop Detected"),
+    [510] = STATUS_LINE(510, "Not Extended"),
+    [511] = STATUS_LINE(511, "Network Authentication Required"),
 };
-static const int num_status4xx_codes =
-    sizeof(status4xx_codes) / sizeof(http_status_code_t);
 
-static const http_status_code_t status5xx_codes[] = {
-    // Server error responses
-    {500, "Internal Server Error"},
-    {501, "Not Implemented"},
-    {502, "Bad Gateway"},
-    {503, "Service Unavailable"},
-    {504, "Gateway Timeout"},
-    {505, "HTTP Version Not Supported"},
-    {506, "Variant Also Negotiates"},
-    {507, "Insufficient Storag"},
-    {508, "Loop Detected"},
-    {510, "Not Extended"},
-    {511, "Network Authentication Required"}};
-static const int num_status5xx_codes =
-    sizeof(status5xx_codes) / sizeof(http_status_code_t);
-
-static webconfig_t *web_config;
-static uv_loop_t *loop;
-static uv_signal_t sigint_handle, sigterm_handle;
-static uv_timer_t release_timer;
-// HTTP parser settings
-static llhttp_settings_t settings;
+typedef struct webserver_s {
+  uv_loop_t *loop; /* loop of the caller, handles the signals */
+  worker_t *workers;
+  uint32_t num_workers;
+  mime_table_t mime_types; /* shared by the workers */
+  error_page_t error_pages[NUM_ERROR_PAGES]; /* shared by the workers */
+  fswatch_t fswatch; /* changes below www_root, on the loop of the caller */
+  uv_signal_t sigint_handle, sigterm_handle;
+#ifdef SIGUSR1
+  uv_signal_t sigusr1_handle; /* prints the counters */
+#endif
+} webserver_t;
 
 static void on_write(uv_write_t *req, int status);
+static void on_handle_close(uv_handle_t *handle);
+static void on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf);
+static void on_alloc(uv_handle_t *handle, size_t suggested_size,
+                     uv_buf_t *buf);
+static void flush_responses(client_t *client);
+static void trim_read_buffer(client_t *client);
+
+// most bytes of header fields and values kept for a request, the connection
+// of a request with more is closed
+#define MAX_HEADERS_SIZE (16 * 1024)
+// most header fields of a request
+#define MAX_HEADERS 128
+// most bytes of a request target
+#define MAX_URL_SIZE (8 * 1024)
+// least room for a body, doubled as the chunks arrive
+#define BODY_MIN_CAPACITY 256
+
+// room for a response header, the header buffers of a worker are this large
+#define RESPONSE_HEADER_SIZE 2048
+// objects allocated at once by the pools of a worker
+#define POOL_SLAB_OBJECTS 64
+
+// least room for a read, the buffer is compacted or replaced below it
+#define READ_BUFFER_MIN_FREE (4 * 1024)
+// most bytes of a buffer kept for the header of the request being parsed
+#define READ_BUFFER_MAX (64 * 1024)
 
-static client_t *activeClientList = NULL;
+/**
+ * @brief Gets a read buffer, from the pool of the worker unless larger than
+ *        its buffers. A larger buffer gets twice the capacity asked for, the
+ *        header outgrowing it needs fewer copies.
+ *
+ * @return Returns the buffer with a reference, or NULL if out of memory.
+ */
+static read_buffer_t *read_buffer_new(worker_t *worker, uint32_t capacity) {
+  pool_t *pool = &worker->read_buffers;
+  const uint32_t pool_capacity = pool->size - sizeof(read_buffer_t);
+  read_buffer_t *rbuf;
+  if (capacity <= pool_capacity) {
+    rbuf = pool_get(pool);
+    capacity = pool_capacity;
+  } else {
+    capacity = capacity > READ_BUFFER_MAX ? capacity : capacity * 2;
+    rbuf = malloc(sizeof(read_buffer_t) + capacity);
+    pool = NULL;
+    worker->large_read_buffers++;
+  }
+  if (rbuf != NULL) {
+    rbuf->pool = pool;
+    rbuf->refcount = 1;
+    rbuf->capacity = capacity;
+    rbuf->length = 0;
+  }
+  return rbuf;
+}
 
-static void free_client(client_t *client) {
-  if (client->request.url != NULL) {
-    free(client->request.url);
-    client->request.url = NULL;
+static void read_buffer_release(read_buffer_t *rbuf) {
+  if (rbuf == NULL || --rbuf->refcount > 0) {
+    return;
   }
-  if (client->request.body != NULL) {
-    free(client->request.body);
-    client->request.body = NULL;
+  if (rbuf->pool != NULL) {
+    pool_put(rbuf->pool, rbuf);
+  } else {
+    free(rbuf);
   }
-  if (client->request.query_param != NULL) {
-    utarray_free(client->request.query_param);
+}
+
+static request_t *create_request(client_t *client) {
+  request_t *req = (request_t *)pool_get(&client->worker->requests);
+  if (req != NULL) {
+    memset(req, 0, offsetof(request_t, arena));
+    arena_init(&req->arena, req->arena_block, REQUEST_ARENA_SIZE);
+    req->client = client;
   }
-  free(client);
+  return req;
 }
 
-static void cleanup_freeList(uv_timer_t *handle) {
-  UNUSED(handle);
-  // clean
-  client_t *elt, *tmp;
-  LL_FOREACH_SAFE(activeClientList, elt, tmp) {
-    if (CLIENT_IS_FLAGS_FREE(elt)) {
-      LL_DELETE(activeClientList, elt);
-      free_client(elt);
-    }
+/**
+ * @brief Gives the response header of a request back to the pool.
+ */
+static void release_header(request_t *req) {
+  response_t *res = &req->response;
+  pool_put(&req->client->worker->headers, res->header);
+  res->header = NULL;
+}
+
+static void free_request(request_t *req) {
+  response_t *res = &req->response;
+  read_buffer_release(req->rbuf);
+  release_header(req);
+  if (res->cached != NULL) {
+    filecache_release(res->cached);
+  }
+  if (res->file != NULL) {
+    fdcache_release(res->file);
   }
+  if (req->identity != NULL) {
+    fdcache_release(req->identity);
+  }
+  free(res->body);
+  arena_reset(&req->arena);
+  pool_put(&req->client->worker->requests, req);
 }
 
-static void cleanup_resources(void) {
-  client_t *elt, *tmp;
-  LL_FOREACH_SAFE(activeClientList, elt, tmp) {
-    LL_DELETE(activeClientList, elt);
-    free_client(elt);
+static void free_client(client_t *client) {
+  request_t *elt, *tmp;
+  DL_FOREACH_SAFE(client->requests, elt, tmp) {
+    DL_DELETE(client->requests, elt);
+    free_request(elt);
+  }
+  if (client->parsing != NULL) {
+    free_request(client->parsing);
+  }
+  if (client->writable_fd >= 0) {
+    close(client->writable_fd);
   }
+  if (client->pipe_fds[0] >= 0) {
+    close(client->pipe_fds[0]);
+    close(client->pipe_fds[1]);
+  }
+  read_buffer_release(client->rbuf);
+  pool_put(&client->worker->clients, client);
 }
 
-static void setup_cleanup_timer(uv_loop_t *loop) {
-  // Release resource1 after 200ms
-  uv_timer_init(loop, &release_timer);
-  uv_timer_start(&release_timer, (uv_timer_cb)&cleanup_freeList, 200, 200);
+/**
+ * @brief Drops a reference on a client, the client is freed once its
+ *        handles are closed and its pipeline is empty.
+ */
+static void release_client(client_t *client) {
+  if (--client->refcount > 0) {
+    return;
+  }
+  DL_DELETE(client->worker->activeClientList, client);
+  free_client(client);
 }
 
-/* -------------------------------------------------------------------------------------------
+/**
+ * @brief Removes a request from the pipeline of its client and frees it.
+ *
+ * @param req Pointer to the request, it must not have anything in flight.
  */
+static void release_request(request_t *req) {
+  client_t *client = req->client;
+  DL_DELETE(client->requests, req);
+  client->num_queued--;
+  free_request(req);
+  release_client(client);
+}
 
-static const char *match_mime_type(const char *path) {
-  const char *ext = strrchr(path, '.');
-  if (!ext) {
-    // Handle unknown extension cases (set default or error)
-    return "application/octet-stream";
-  }
+static bool client_is_closing(const client_t *client) {
+  return uv_is_closing((uv_handle_t *)&client->handle);
+}
 
-  const char *content_type = "application/octet-stream";
+/**
+ * @brief Closes the connection of a client.
+ *
+ * Requests with nothing in flight are released right away, the others are
+ * released from the callback of their fs or write request. The client itself
+ * is released once all its handles are closed and its pipeline is empty.
+ *
+ * @param client Pointer to the client to close.
+ */
+static void close_client(client_t *client) {
+  if (client_is_closing(client)) {
+    return;
+  }
+  uv_read_stop((uv_stream_t *)&client->handle);
 
-  for (size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); i++) {
-    if (strcasecmp(ext, mime_types[i].ext) == 0) {
-      content_type = mime_types[i].content_type;
-      break;
+  if (client->parsing != NULL) {
+    free_request(client->parsing);
+    client->parsing = NULL;
+  }
+  request_t *elt, *tmp;
+  DL_FOREACH_SAFE(client->requests, elt, tmp) {
+    if (elt->state == REQUEST_STATE_READY ||
+        elt->state == REQUEST_STATE_WAITING) {
+      release_request(elt);
     }
   }
-  return content_type;
-}
-
-static const char *status_string(llhttp_status_t status) {
-  const http_status_code_t *p = NULL;
-  int max_statuscode = 0;
-
-  if ((status >= 100) && (status < 200)) {
-    p = &status1xx_codes[0];
-    max_statuscode = num_status1xx_codes;
-  } else if ((status >= 200) && (status < 300)) {
-    p = &status2xx_codes[0];
-    max_statuscode = num_status2xx_codes;
-  } else if ((status >= 300) && (status < 400)) {
-    p = &status3xx_codes[0];
-    max_statuscode = num_status3xx_codes;
-  } else if ((status >= 400) && (status < 500)) {
-    p = &status4xx_codes[0];
-    max_statuscode = num_status4xx_codes;
-  } else if ((status >= 500) && (status < 600)) {
-    p = &status5xx_codes[0];
-    max_statuscode = num_status5xx_codes;
-  } else {
-    return "Unknow Status";
+
+  client->closing_handles = 2;
+  uv_close((uv_handle_t *)&client->idle_timer, on_handle_close);
+  if (client->writable_fd >= 0) {
+    client->closing_handles++;
+    uv_close((uv_handle_t *)&client->writable, on_handle_close);
+  }
+  uv_close((uv_handle_t *)&client->handle, on_handle_close);
+}
+
+static void on_idle_timeout(uv_timer_t *handle) {
+  client_t *client = (client_t *)handle->data;
+  fprintf(stdout, "keep-alive timeout, close the connection\n\n");
+  close_client(client);
+}
+
+/**
+ * @brief Arms the keep-alive timer of an idle client.
+ *
+ * The connection is closed if no complete request arrives within
+ * web_config->keepalive_timeout.
+ *
+ * @param client Pointer to the client.
+ */
+static void wait_request(client_t *client) {
+  const webconfig_t *web_config = client->worker->config;
+  if (web_config->keepalive_timeout > 0) {
+    uv_timer_start(&client->idle_timer, on_idle_timeout,
+                   web_config->keepalive_timeout, 0);
+  }
+}
+
+// frees the clients left once the loop of the worker has stopped
+static void cleanup_resources(worker_t *worker) {
+  client_t *elt, *tmp;
+  DL_FOREACH_SAFE(worker->activeClientList, elt, tmp) {
+    DL_DELETE(worker->activeClientList, elt);
+    free_client(elt);
   }
+}
 
-  for (int i = 0; i < max_statuscode; i++) {
-    if (status == p[i].code)
-      return p[i].reason_phrase;
+/* -------------------------------------------------------------------------------------------
+ */
+
+static const mime_type_t *match_mime_type(const worker_t *worker,
+                                          const char *path) {
+  return mime_table_lookup(worker->mime_types, path);
+}
+
+/**
+ * @brief Appends a header fragment rendered in advance.
+ *
+ * @return Returns the length of the fragment, or 0 if it doesn't fit.
+ */
+static int copy_fragment(char *buf, uint32_t len, const char *fragment,
+                         uint32_t length) {
+  if (length >= len) {
+    return 0;
   }
-  return "Unknow Status";
+  memcpy(buf, fragment, length);
+  return length;
 }
 
 static const int make_header_status(llhttp_status_t status, char *buf,
                                     uint32_t len) {
-  return snprintf(buf, len, "HTTP/1.1 %d %s\r\n", status,
-                  status_string(status));
+  if (status < HTTP_STATUS_MAX && status_lines[status].line != NULL) {
+    return copy_fragment(buf, len, status_lines[status].line,
+                         status_lines[status].length);
+  }
+  return snprintf(buf, len, "HTTP/1.1 %d Unknow Status\r\n", status);
 }
 
-static const int make_header_content_type(const char *content_type, char *buf,
+static const int make_header_content_type(const mime_type_t *mime, char *buf,
                                           uint32_t len) {
-  return snprintf(buf, len, "Content-Type: %s\r\n", content_type);
+  return copy_fragment(buf, len, mime->header, mime->length_header);
 }
 
+#define CONTENT_LENGTH_PREFIX "Content-Length: "
+
 static const int make_header_content_length(size_t content_length, char *buf,
                                             uint32_t len) {
-  return snprintf(buf, len, "Content-Length: %ld\r\n", content_length);
+  const uint32_t length_prefix = sizeof(CONTENT_LENGTH_PREFIX) - 1;
+  if (length_prefix + UINT64_DIGITS + 2 >= len) {
+    return 0;
+  }
+  memcpy(buf, CONTENT_LENGTH_PREFIX, length_prefix);
+  int cnt = length_prefix + format_uint64(content_length, buf + length_prefix);
+  memcpy(buf + cnt, "\r\n", 2);
+  return cnt + 2;
 }
 
-static uv_buf_t make_response_header(llhttp_status_t status, response_t *res) {
-  if (res == NULL) {
-    return uv_buf_init(NULL, 0);
-  }
+static const char *header_keep_alive = "Connection: keep-alive\r\n";
+static const char *header_close = "Connection: close\r\n";
 
-  char buf[2048];
-  char *ret = buf;
-  int len = sizeof(buf);
-  int cnt = 0;
+static const int make_header_connection(bool keep_alive, char *buf,
+                                        uint32_t len) {
+  const char *connection = keep_alive ? header_keep_alive : header_close;
+  return copy_fragment(buf, len, connection, strlen(connection));
+}
 
-  if (ret != NULL) {
-    cnt = make_header_status(status, ret, len);
-    len -= cnt;
-    if (res->mime_content != NULL) {
-      cnt += make_header_content_type(res->mime_content, ret + cnt, len);
-      len -= cnt;
+static const content_encoding_t *find_content_encoding(uint8_t bit) {
+  for (int i = 0; i < num_content_encodings; i++) {
+    if (content_encodings[i].bit == bit) {
+      return &content_encodings[i];
     }
-    // always include 'Content-Length' field, even the value is zero
-    cnt += make_header_content_length(res->size_content, ret + cnt, len);
-    len -= cnt;
-    cnt += snprintf(ret + cnt, len, "\r\n");
   }
-
-  uv_buf_t uv_buf = uv_buf_init(malloc(cnt), cnt);
-  strncpy(uv_buf.base, buf, cnt);
-  return uv_buf;
+  return NULL;
 }
 
-static void on_final_fix_response(uv_write_t *req, int status) {
-  if (status == 0) {
-    assert(req->nbufs == 2);
-    client_t *client = (client_t *)req->data;
-    free(client->response.buf[0].base);
-
-    // the content for pre-defined fixed address
-    // not in heap/malloc
-    // free(client->response.buf[1].base);
-    free(client->response.buf);
-    client->response.buf = NULL;
+// Content-Encoding of the file and Vary if the file has variants
+static int make_header_encoding(const response_t *res, char *buf,
+                                uint32_t len) {
+  int cnt = 0;
+  if (res->content_encoding != 0) {
+    cnt += snprintf(buf, len, "Content-Encoding: %s\r\n",
+                    find_content_encoding(res->content_encoding)->name);
   }
-  free(req);
+  if (res->vary_encoding) {
+    cnt += snprintf(buf + cnt, len - cnt, "Vary: Accept-Encoding\r\n");
+  }
+  return cnt;
 }
 
-static void make_fixed_response(client_t *client, const llhttp_status_t code,
-                                const char *mime_type, const char *content) {
-  response_t *res = &client->response;
-  const size_t len = strlen(content);
+// longest entity tag made by make_etag(), with its NUL terminator
+#define ETAG_SIZE 64
 
-  res->buf = malloc(2 * sizeof(uv_buf_t));
-  res->mime_content = mime_type;
-  res->size_content = len;
-  res->buf[0] = make_response_header(code, res);
-  res->buf[1] = uv_buf_init((char *)content, len);
+/**
+ * @brief Makes the entity tag of a file from its stat.
+ *
+ * The tag changes with the inode, the size or the modification time. It is
+ * weak while the file has been modified within the last second, another
+ * change within the same timestamp would go unnoticed.
+ *
+ * @param stat     Stat of the file.
+ * @param encoding CONTENT_ENCODING_xxx the file is compressed with on the
+ *                 fly, 0 if sent as is.
+ * @param buf      Receives the tag, ETAG_SIZE bytes.
+ *
+ * @return Returns the length of the tag.
+ */
+static int make_etag(const uv_stat_t *stat, uint8_t encoding, char *buf) {
+  const bool weak = stat->st_mtim.tv_sec + 1 >= (int64_t)time(NULL);
+  const uint64_t mtime =
+      (uint64_t)stat->st_mtim.tv_sec * 1000000000 + stat->st_mtim.tv_nsec;
+  const content_encoding_t *coding = find_content_encoding(encoding);
+  return snprintf(buf, ETAG_SIZE,
+                  "%s\"%" PRIx64 "-%" PRIx64 "-%" PRIx64 "%s%s\"",
+                  weak ? "W/" : "", (uint64_t)stat->st_ino,
+                  (uint64_t)stat->st_size, mtime, coding != NULL ? "-" : "",
+                  coding != NULL ? coding->name : "");
+}
 
-  // send response
-  uv_write_t *write_req = malloc(sizeof(uv_write_t));
-  write_req->data = (void *)client;
-  uv_write(write_req, (uv_stream_t *)&client->handle, res->buf, 2,
-           on_final_fix_response);
+// ETag and Last-Modified of a file
+static int make_header_validators(worker_t *worker, const uv_stat_t *stat,
+                                  uint8_t encoding, char *buf, uint32_t len) {
+  char etag[ETAG_SIZE];
+  make_etag(stat, encoding, etag);
+  const char *date =
+      http_date_cached(&worker->last_modified, stat->st_mtim.tv_sec);
+  return snprintf(buf, len, "ETag: %s\r\nLast-Modified: %s\r\n", etag, date);
 }
 
-static void send_text_response(client_t *client, const llhttp_status_t code,
-                               const char *content) {
-  make_fixed_response(client, code, match_mime_type(".txt"), content);
+// Date of the response, formatted by on_date_timer()
+static int make_header_date(const worker_t *worker, char *buf, uint32_t len) {
+  return copy_fragment(buf, len, worker->date_header,
+                       worker->length_date_header);
 }
 
-static void send_html_response(client_t *client, const llhttp_status_t code,
-                               const char *content) {
-  make_fixed_response(client, code, match_mime_type(".html"), content);
+/*
+ * the header fields describing the content, the same for every request of
+ * the content (so without Date, Connection and the end of the header)
+ */
+static int make_content_header(llhttp_status_t status, const request_t *req,
+                               char *buf, uint32_t len) {
+  const response_t *res = &req->response;
+  int cnt = make_header_status(status, buf, len);
+  if (res->mime != NULL) {
+    cnt += make_header_content_type(res->mime, buf + cnt, len - cnt);
+  }
+  // always include 'Content-Length' field, even the value is zero
+  cnt += make_header_content_length(res->size_content, buf + cnt, len - cnt);
+  cnt += make_header_encoding(res, buf + cnt, len - cnt);
+  if (res->file == NULL) {
+    return cnt;
+  }
+
+  const uint64_t size = res->file->stat.st_size;
+  cnt += make_header_validators(req->client->worker, &res->file->stat,
+                                res->compressed ? res->content_encoding : 0,
+                                buf + cnt, len - cnt);
+  if (res->compressed) {
+    // ranges are served from the file, not from the compressed content
+    return cnt;
+  }
+  cnt += snprintf(buf + cnt, len - cnt, "Accept-Ranges: bytes\r\n");
+  if (status == HTTP_STATUS_PARTIAL_CONTENT && res->num_ranges == 1) {
+    cnt += snprintf(buf + cnt, len - cnt,
+                    "Content-Range: bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64
+                    "\r\n",
+                    res->ranges[0].start, res->ranges[0].end - 1, size);
+  } else if (status == HTTP_STATUS_RANGE_NOT_SATISFIABLE) {
+    cnt += snprintf(buf + cnt, len - cnt,
+                    "Content-Range: bytes */%" PRIu64 "\r\n", size);
+  }
+  return cnt;
 }
 
-static void on_close_sendfile(uv_fs_t *fs_req) {
-  uv_fs_req_cleanup(fs_req);
-  free(fs_req);
+/**
+ * @brief Builds the complete header of a response in a header buffer of the
+ *        worker.
+ *
+ * @return Returns the header, to be set as res->header, or an empty buffer if
+ *         out of memory.
+ */
+static uv_buf_t make_response_header(llhttp_status_t status, request_t *req) {
+  const response_t *res = &req->response;
+  char *buf = pool_get(&req->client->worker->headers);
+  if (buf == NULL) {
+    return uv_buf_init(NULL, 0);
+  }
+
+  const int len = RESPONSE_HEADER_SIZE;
+  int cnt = make_content_header(status, req, buf, len);
+  cnt += make_header_date(req->client->worker, buf + cnt, len - cnt);
+  cnt += make_header_connection(res->keep_alive, buf + cnt, len - cnt);
+  cnt += copy_fragment(buf + cnt, len - cnt, "\r\n", 2);
+  return uv_buf_init(buf, cnt);
 }
 
-static void final_sendfile(uv_fs_t *fs_req) {
-  client_t *client = (client_t *)fs_req->data;
-  const response_t *res = &client->response;
+/**
+ * @brief Feeds the received bytes to the HTTP parser of a client.
+ *
+ * The parser gets paused by on_message_complete() once the pipeline is full
+ * or after the last request of the connection, the bytes following it are
+ * left in client->rbuf and reading is stopped until resume_parsing().
+ *
+ * @param client Pointer to the client, client->rbuf holds unparsed bytes.
+ */
+static void parse_request_data(client_t *client) {
+  llhttp_t *parser = &client->parser;
+  const char *data = client->rbuf->data + client->parsed;
+  const size_t len = client->rbuf->length - client->parsed;
+  // Parse the received data
+  enum llhttp_errno err = llhttp_execute(parser, data, len);
+  if (client_is_closing(client)) {
+    // a response got aborted while parsing, the rest is never answered
+    return;
+  }
+  if (err == HPE_PAUSED) {
+    client->parsed += llhttp_get_error_pos(parser) - data;
+    client->paused = true;
+    uv_read_stop((uv_stream_t *)&client->handle);
+    return;
+  }
+  client->parsed += len;
 
-  uv_fs_t *req_close = (uv_fs_t *)malloc(sizeof(uv_fs_t));
-  uv_fs_close(loop, req_close, res->open_file, on_close_sendfile);
-  uv_fs_req_cleanup(fs_req);
-  free(fs_req);
-  CLIENT_CLEAR_IN_REF(client);
+  if (err != HPE_OK) {
+    fprintf(stderr, "Parse error: %s %s\n", llhttp_errno_name(err),
+            client->parser.reason);
+    close_client(client);
+  }
 }
 
-static void send_file_context(uv_fs_t *fs_req) {
-  client_t *client = (client_t *)fs_req->data;
-  response_t *res = &client->response;
+/**
+ * @brief Resumes a paused parser once the pipeline has room again.
+ *
+ * The parser stays paused for good after the last request of the connection
+ * (no keep-alive), the connection gets closed after its response.
+ *
+ * @param client Pointer to the client.
+ */
+static void resume_parsing(client_t *client) {
+  const webconfig_t *web_config = client->worker->config;
+  if (!client->paused || client_is_closing(client) ||
+      client->num_queued >= web_config->pipeline_depth) {
+    return;
+  }
+  if (client->requests != NULL && !client->requests->prev->response.keep_alive) {
+    return;
+  }
 
-  // FIXME: only for linux
-  if (fs_req->result >= 0) {
-    uv_os_fd_t sendfd;
-    uv_fs_t *send_req = (uv_fs_t *)malloc(sizeof(uv_fs_t));
-    send_req->data = client;
-    uv_fileno((uv_handle_t *)&client->handle, &sendfd);
-    CLIENT_SET_IN_REF(client);
-    res->open_file = fs_req->result; // store the file handler
-    uv_fs_sendfile(loop, send_req, sendfd, fs_req->result, 0, res->size_content,
-                   final_sendfile);
-#ifdef _WIN32
-#error "because windows not support sendfile(), need implement"
-#endif
+  client->paused = false;
+  llhttp_resume(&client->parser);
+  if (client->rbuf != NULL && client->parsed < client->rbuf->length) {
+    parse_request_data(client);
+    trim_read_buffer(client);
+  }
+  if (!client->paused && !client->eof && !client_is_closing(client)) {
+    uv_read_start((uv_stream_t *)&client->handle, on_alloc, on_read);
   }
+}
 
-  // release path
-  free(res->path_content);
-  res->path_content = NULL;
+/**
+ * @brief Completes the response at the head of the pipeline.
+ *
+ * Releases the request and either closes the connection or carries on with
+ * the next response in the pipeline, the connection turns idle once the
+ * pipeline is empty.
+ *
+ * @param req Pointer to the request whose response has been sent.
+ */
+static void finish_response(request_t *req) {
+  client_t *client = req->client;
+  const bool keep_alive = req->response.keep_alive;
+  release_request(req);
+  if (!keep_alive) {
+    close_client(client);
+    return;
+  }
 
-  uv_fs_req_cleanup(fs_req);
-  free(fs_req);
+  resume_parsing(client);
+  if (client_is_closing(client)) {
+    return;
+  }
+  if (client->requests == NULL) {
+    if (client->eof) {
+      close_client(client);
+    } else {
+      wait_request(client);
+    }
+  } else {
+    flush_responses(client);
+  }
 }
 
-static void open_send_file(uv_write_t *req, int status) {
-  client_t *client = (client_t *)req->data;
-  response_t *res = &client->response;
-  if (status == 0) {
-    uv_fs_t *fs_req = malloc(sizeof(uv_fs_t));
-    fs_req->data = client;
-    uv_fs_open(loop, fs_req, res->path_content, O_RDONLY, (S_IRUSR | S_IRGRP),
-               send_file_context);
+/**
+ * @brief Checks whether a request outlived the connection of its client.
+ *
+ * To be called first in every fs or write callback of a request, a request
+ * of a closing client is released and must not be used anymore.
+ *
+ * @param req Pointer to the request.
+ *
+ * @return Returns true if the request has been released.
+ */
+static bool request_is_orphan(request_t *req) {
+  if (client_is_closing(req->client)) {
+    release_request(req);
+    return true;
   }
+  return false;
+}
 
-  free(res->buf->base);
-  free(res->buf);
-  free(req);
+static void abort_response(request_t *req) {
+  client_t *client = req->client;
+  // close first, so the request is the only one left to release here
+  close_client(client);
+  release_request(req);
 }
 
-static void found_and_sendfs_req(client_t *client) {
-  response_t *res = &client->response;
-  res->buf = malloc(sizeof(uv_buf_t));
-  *res->buf = make_response_header(HTTP_STATUS_OK, res);
-  // send header of response;
-  uv_write_t *write_req = malloc(sizeof(uv_write_t));
-  write_req->data = (void *)client;
-  uv_write(write_req, (uv_stream_t *)&client->handle, res->buf, 1,
-           open_send_file);
-}
-
-static void check_default_files_async(uv_fs_t *fs_req) {
-  client_t *client = (client_t *)fs_req->data;
-  request_t *req = &client->request;
-  response_t *res = &client->response;
-
-  if (fs_req->result != 0) {
-    // fprintf(stdout, "Can't find file: %s\n", fs_req->path);
-    req->default_filename_tries++;
-    if (req->default_filename_tries >= web_config->def_cnt) {
-      send_html_response(client, HTTP_STATUS_NOT_FOUND, res404content);
-      uv_fs_req_cleanup(fs_req);
-      free(fs_req);
-      return;
-    }
+static void send_file_chunk(request_t *req);
+static bool send_next_part(request_t *req);
 
-    char path[MAX_PATH_LENGTH];
-    const int len = strlen(req->url);
-    if (len > 1 && req->url[len - 1] != '/') {
-      res->length_path =
-          snprintf(path, MAX_PATH_LENGTH, "%s%s/%s", web_config->www_root,
-                   req->url, web_config->defaults[req->default_filename_tries]);
-    } else {
-      res->length_path =
-          snprintf(path, MAX_PATH_LENGTH, "%s%s%s", web_config->www_root,
-                   req->url, web_config->defaults[req->default_filename_tries]);
-    }
+static void on_writable(uv_poll_t *handle, int status, int events) {
+  UNUSED(events);
+  client_t *client = (client_t *)handle->data;
+  request_t *req = client->requests;
+  uv_poll_stop(handle);
+  if (status < 0) {
+    close_client(client);
+    return;
+  }
+  req->state = REQUEST_STATE_SENDING;
+  send_file_chunk(req);
+}
 
-    if (res->length_path >= MAX_PATH_LENGTH) {
-      send_html_response(client, HTTP_STATUS_INTERNAL_SERVER_ERROR,
-                         res500content);
-      uv_fs_req_cleanup(fs_req);
-      free(fs_req);
+/**
+ * @brief Waits for the socket to drain before continuing a sendfile.
+ *
+ * libuv doesn't expose the writable state of a TCP handle, a dup of the
+ * socket is polled instead (epoll tracks the duplicate separately).
+ *
+ * @param req Pointer to the request being sent.
+ */
+static void wait_writable(request_t *req) {
+  client_t *client = req->client;
+  if (client->writable_fd < 0) {
+    uv_os_fd_t sockfd;
+    uv_fileno((uv_handle_t *)&client->handle, &sockfd);
+    const int fd = dup(sockfd);
+    if (fd < 0 ||
+        uv_poll_init_socket(client->worker->loop, &client->writable, fd) != 0) {
+      if (fd >= 0)
+        close(fd);
+      abort_response(req);
       return;
     }
+    client->writable.data = client;
+    client->writable_fd = fd;
+  }
+  req->state = REQUEST_STATE_WAITING;
+  uv_poll_start(&client->writable, UV_WRITABLE, on_writable);
+}
+
+/**
+ * @brief Holds back partial frames of a client socket (TCP_CORK).
+ *
+ * Corked while the header of a file response is written, so the header goes
+ * out in the same packet as the start of the file. Without TCP_CORK the
+ * header is still sent right before the file, only not merged.
+ *
+ * @param client Pointer to the client.
+ * @param on     true to cork, false to push out what is pending.
+ */
+static void set_cork(client_t *client, bool on) {
+#ifdef TCP_CORK
+  uv_os_fd_t fd;
+  const int value = on;
+  if (client->corked == on ||
+      uv_fileno((uv_handle_t *)&client->handle, &fd) != 0) {
+    return;
+  }
+  setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+  client->corked = on;
+#else
+  UNUSED(client);
+  UNUSED(on);
+#endif
+}
+
+// largest chunk sent by a sendfile() on the loop thread (or read by io_uring)
+#define SENDFILE_DIRECT_CHUNK (256 * 1024)
+
+#ifdef __linux__
+/**
+ * @brief Tells whether a range of a file is in the page cache, every page
+ *        of it.
+ *
+ * The range is mapped without touching it and its pages are looked up with
+ * mincore(), a few system calls whatever the length of the range.
+ */
+static bool range_is_cached(int fd, size_t offset, size_t len) {
+  static size_t page_size;
+  if (page_size == 0) {
+    page_size = sysconf(_SC_PAGESIZE);
+  }
+  const size_t start = offset & ~(page_size - 1);
+  const size_t length = offset + len - start;
+  unsigned char pages[SENDFILE_DIRECT_CHUNK / 4096 + 1];
+  const size_t num_pages = (length + page_size - 1) / page_size;
+  if (num_pages > sizeof(pages)) {
+    return false;
+  }
+  void *map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, start);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  bool cached = mincore(map, length, pages) == 0;
+  for (size_t i = 0; cached && i < num_pages; i++) {
+    cached = pages[i] & 1;
+  }
+  munmap(map, length);
+  return cached;
+}
 
-    // next default req
-    fprintf(stdout, "try next default file:%s\n", path);
-    uv_fs_t *new_req = malloc(sizeof(uv_fs_t));
-    new_req->data = client;
-    uv_fs_stat(loop, new_req, path, check_default_files_async);
+/**
+ * @brief Sends a chunk of a file with sendfile() on the calling thread.
+ *
+ * Only done if all the pages of the chunk are in the page cache, so neither
+ * the socket (non-blocking) nor the disk can block.
+ *
+ * @param sockfd The socket.
+ * @param fd     The file.
+ * @param offset Offset of the chunk in the file.
+ * @param len    Length of the chunk, sent up to SENDFILE_DIRECT_CHUNK.
+ *
+ * @return Returns the number of bytes sent, UV_EBUSY if the file has to be
+ *         read from the disk, or a libuv error code (UV_EAGAIN if the socket
+ *         buffer is full).
+ */
+static ssize_t sendfile_nowait(int sockfd, int fd, size_t offset, size_t len) {
+  if (len > SENDFILE_DIRECT_CHUNK) {
+    len = SENDFILE_DIRECT_CHUNK;
+  }
+  if (!range_is_cached(fd, offset, len)) {
+    return UV_EBUSY;
+  }
+  off_t off = offset;
+  const ssize_t r = sendfile(sockfd, fd, &off, len);
+  return r >= 0 ? r : uv_translate_sys_error(errno);
+}
+#else
+static ssize_t sendfile_nowait(int sockfd, int fd, size_t offset, size_t len) {
+  UNUSED(sockfd);
+  UNUSED(fd);
+  UNUSED(offset);
+  UNUSED(len);
+  return UV_EBUSY;
+}
+#endif
 
-    uv_fs_req_cleanup(fs_req);
-    free(fs_req);
+/**
+ * @brief Carries on with a file response after a sendfile.
+ *
+ * @param req    Pointer to the request being sent.
+ * @param result Bytes sent, or a libuv error code.
+ */
+static void on_file_sent(request_t *req, ssize_t result) {
+  response_t *res = &req->response;
+  // the header left with the first chunk of the file
+  set_cork(req->client, false);
+  if (result == UV_EAGAIN) {
+    wait_writable(req);
+    return;
+  }
+  if (result <= 0) {
+    // the header is out already, the client can't tell the failure
+    abort_response(req);
     return;
   }
 
-  // find file will send the file to user
-  res->size_content = fs_req->statbuf.st_size;
-  res->path_content = strdup(fs_req->path);
-  res->mime_content = match_mime_type(fs_req->path);
-  found_and_sendfs_req(client);
+  // the rest of the file, or the end of the response
+  res->sent += result;
+  send_file_chunk(req);
+}
 
+static void final_sendfile(uv_fs_t *fs_req) {
+  request_t *req = (request_t *)fs_req->data;
+  const ssize_t result = fs_req->result;
   uv_fs_req_cleanup(fs_req);
-  free(fs_req);
+  pool_put(&req->client->worker->fs_reqs, fs_req);
+
+  if (request_is_orphan(req)) {
+    return;
+  }
+  on_file_sent(req, result);
+}
+
+#ifdef HAVE_LIBURING
+/**
+ * @brief Moves the part of the file read into the client pipe to the socket.
+ *
+ * @param req    Pointer to the request being sent.
+ * @param sockfd The socket.
+ *
+ * @return Returns true once the pipe is empty, false if the response waits
+ *         for the socket or has been aborted.
+ */
+static bool drain_pipe(request_t *req, int sockfd) {
+  client_t *client = req->client;
+  response_t *res = &req->response;
+  while (res->piped > 0) {
+    const ssize_t r = splice(client->pipe_fds[0], NULL, sockfd, NULL,
+                             res->piped, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (r < 0) {
+      set_cork(client, false);
+      if (errno == EAGAIN) {
+        wait_writable(req);
+      } else {
+        abort_response(req);
+      }
+      return false;
+    }
+    res->piped -= r;
+  }
+  set_cork(client, false);
+  return true;
 }
 
-static void check_path_async(uv_fs_t *fs_req) {
-  client_t *client = (client_t *)fs_req->data;
-  request_t *req = &client->request;
-  response_t *res = &client->response;
+static void on_file_spliced(uring_req_t *ureq) {
+  request_t *req = (request_t *)ureq->data;
+  response_t *res = &req->response;
+  const ssize_t result = ureq->result;
+  uring_req_cleanup(ureq);
+  pool_put(&req->client->worker->uring_reqs, ureq);
 
-  if (fs_req->result < 0) {
-    fprintf(stdout, "check fs_stat failed\n");
-    send_html_response(client, HTTP_STATUS_NOT_FOUND, res404content);
-    uv_fs_req_cleanup(fs_req);
-    free(fs_req);
+  if (request_is_orphan(req)) {
     return;
   }
+  if (result <= 0) {
+    set_cork(req->client, false);
+    abort_response(req);
+    return;
+  }
+  res->sent += result;
+  res->piped = result;
+  send_file_chunk(req);
+}
 
-  const uv_stat_t *stat = &fs_req->statbuf;
-  if (S_ISDIR(stat->st_mode)) {
-    req->default_filename_tries = 0;
-
-    char path[MAX_PATH_LENGTH];
-    const int len = strlen(fs_req->path);
-    if (len > 1 && fs_req->path[len - 1] != '/') {
-      res->length_path =
-          snprintf(path, MAX_PATH_LENGTH, "%s/%s", fs_req->path,
-                   web_config->defaults[req->default_filename_tries]);
-    } else {
-      res->length_path =
-          snprintf(path, MAX_PATH_LENGTH, "%s%s", fs_req->path,
-                   web_config->defaults[req->default_filename_tries]);
+/**
+ * @brief Reads the next chunk of a file into the pipe of the client.
+ *
+ * The kernel waits for the disk, the loop then moves the chunk from the pipe
+ * to the socket without copying it.
+ *
+ * @param req Pointer to the request being sent.
+ *
+ * @return Returns 0 if the read is submitted, or a libuv error code.
+ */
+static int splice_file_chunk(request_t *req) {
+  client_t *client = req->client;
+  response_t *res = &req->response;
+  if (client->pipe_fds[0] < 0) {
+    if (pipe2(client->pipe_fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+      return uv_translate_sys_error(errno);
     }
-    fprintf(stdout, "try to find default file%s\n", path);
+    fcntl(client->pipe_fds[1], F_SETPIPE_SZ, SENDFILE_DIRECT_CHUNK);
+    const int size = fcntl(client->pipe_fds[1], F_GETPIPE_SZ);
+    client->pipe_size = size > 0 ? (uint32_t)size : 64 * 1024;
+  }
 
-    uv_fs_t *new_req = malloc(sizeof(uv_fs_t));
-    new_req->data = client;
-    uv_fs_stat(loop, new_req, path, check_default_files_async);
+  size_t len = res->send_end - res->sent;
+  if (len > client->pipe_size) {
+    len = client->pipe_size;
+  }
+  uring_req_t *ureq = pool_get(&client->worker->uring_reqs);
+  if (ureq == NULL) {
+    return UV_ENOMEM;
+  }
+  ureq->data = req;
+  const int r = uring_splice(&client->worker->uring, ureq, res->file->fd,
+                             res->sent, client->pipe_fds[1], len,
+                             on_file_spliced);
+  if (r != 0) {
+    pool_put(&client->worker->uring_reqs, ureq);
+  }
+  return r;
+}
+#endif
+
+static void send_file_chunk(request_t *req) {
+  client_t *client = req->client;
+  response_t *res = &req->response;
+
+  // FIXME: only for linux
+  uv_os_fd_t sendfd;
+  uv_fileno((uv_handle_t *)&client->handle, &sendfd);
 
-    uv_fs_req_cleanup(fs_req);
-    free(fs_req);
+#ifdef HAVE_LIBURING
+  // the chunk read by io_uring goes first
+  if (res->piped > 0 && !drain_pipe(req, sendfd)) {
+    return;
+  }
+#endif
+  if (res->sent >= res->send_end) {
+    if (send_next_part(req)) {
+      return;
+    }
+    // the file stays open if the fd cache holds it
+    fdcache_release(res->file);
+    res->file = NULL;
+    finish_response(req);
+    return;
+  }
+
+  if (client->worker->config->sendfile_direct) {
+    // straight from the page cache until the socket is full, the threadpool
+    // is only used for the parts of the file that are on disk
+    ssize_t result;
+    while ((result = sendfile_nowait(sendfd, res->file->fd, res->sent,
+                                     res->send_end - res->sent)) > 0 &&
+           res->sent + result < res->send_end) {
+      res->sent += result;
+    }
+    if (result != UV_EBUSY) {
+      on_file_sent(req, result);
+      return;
+    }
+  }
+#ifdef HAVE_LIBURING
+  if (client->worker->uring.active && splice_file_chunk(req) == 0) {
+    return;
+  }
+#endif
+
+  uv_fs_t *send_req = pool_get(&client->worker->fs_reqs);
+  if (send_req == NULL) {
+    abort_response(req);
+    return;
+  }
+  send_req->data = req;
+  uv_fs_sendfile(client->worker->loop, send_req, sendfd, res->file->fd,
+                 res->sent, res->send_end - res->sent, final_sendfile);
+#ifdef _WIN32
+#error "because windows not support sendfile(), need implement"
+#endif
+}
+
+static void on_response_written(uv_write_t *write_req, int status) {
+  request_t *req = (request_t *)write_req->data;
+  response_t *res = &req->response;
+  pool_put(&req->client->worker->write_reqs, write_req);
+
+  // the content for pre-defined fixed address
+  // not in heap/malloc
+  release_header(req);
+
+  if (request_is_orphan(req)) {
+    return;
+  }
+  if (status != 0) {
+    abort_response(req);
+    return;
+  }
+
+  // the range of the file, or the end of the response (the file is released
+  // there, also for HEAD)
+  if (res->file != NULL) {
+    send_file_chunk(req);
+    return;
+  }
+  finish_response(req);
+}
+
+// skips the bytes of res->buf already written
+static void consume_bufs(response_t *res, size_t written) {
+  uint32_t i = 0;
+  while (i < res->nbufs && written >= res->buf[i].len) {
+    written -= res->buf[i].len;
+    i++;
+  }
+  memmove(res->buf, res->buf + i, (res->nbufs - i) * sizeof(uv_buf_t));
+  res->nbufs -= i;
+  if (res->nbufs > 0) {
+    res->buf[0] =
+        uv_buf_init(res->buf[0].base + written, res->buf[0].len - written);
+  }
+}
+
+/**
+ * @brief Writes res->buf, followed by the range of the file to send if any.
+ *
+ * The buffers are written right away while the socket takes them, only what
+ * is left gets queued with a write request and its trip through the loop.
+ *
+ * @param req Pointer to the request being sent.
+ */
+static void write_response(request_t *req) {
+  client_t *client = req->client;
+  worker_t *worker = client->worker;
+  response_t *res = &req->response;
+  if (res->file != NULL && res->sent < res->send_end) {
+    // the file follows without a trip through the loop, the cork merges the
+    // header and the file into full packets
+    set_cork(client, true);
+  }
+  size_t length = 0;
+  for (uint32_t i = 0; i < res->nbufs; i++) {
+    length += res->buf[i].len;
+  }
+  const int written =
+      uv_try_write((uv_stream_t *)&client->handle, res->buf, res->nbufs);
+  if (written == (int)length) {
+    worker->writes_direct++;
+    release_header(req);
+    // the range of the file, or the end of the response
+    if (res->file != NULL) {
+      send_file_chunk(req);
+    } else {
+      finish_response(req);
+    }
+    return;
+  }
+  if (written < 0 && written != UV_EAGAIN) {
+    // the connection is gone, a queued write would fail as well
+    abort_response(req);
+    return;
+  }
+  if (written > 0) {
+    worker->writes_partial++;
+    consume_bufs(res, written);
+  } else {
+    worker->writes_queued++;
+  }
+
+  uv_write_t *write_req = pool_get(&worker->write_reqs);
+  if (write_req == NULL) {
+    abort_response(req);
+    return;
+  }
+  write_req->data = (void *)req;
+  if (uv_write(write_req, (uv_stream_t *)&client->handle, res->buf, res->nbufs,
+               on_response_written) != 0) {
+    // on_response_written() never gets called
+    pool_put(&worker->write_reqs, write_req);
+    abort_response(req);
+  }
+}
+
+/**
+ * @brief Moves on to the next range of a multipart/byteranges response.
+ *
+ * @param req Pointer to the request being sent.
+ *
+ * @return Returns true if the part header of the next range (or the closing
+ *         delimiter) is being written, false at the end of the response.
+ */
+static bool send_next_part(request_t *req) {
+  response_t *res = &req->response;
+  if (res->range_index + 1 >= res->num_ranges) {
+    return false;
+  }
+
+  const range_t *range = &res->ranges[++res->range_index];
+  res->sent = range->start;
+  res->send_end = range->end;
+  res->buf[0] =
+      uv_buf_init(res->parts + range->part_header, range->length_part_header);
+  res->nbufs = 1;
+  write_response(req);
+  return true;
+}
+
+/**
+ * @brief Starts writing the next prepared response of a client.
+ *
+ * Responses are prepared concurrently but written strictly in the order of
+ * their requests, only the head of the pipeline is ever written.
+ *
+ * @param client Pointer to the client.
+ */
+static void flush_responses(client_t *client) {
+  request_t *req = client->requests;
+  if (req == NULL || req->state != REQUEST_STATE_READY) {
+    return;
+  }
+
+  req->state = REQUEST_STATE_SENDING;
+  write_response(req);
+}
+
+static void response_ready(request_t *req) {
+  req->state = REQUEST_STATE_READY;
+  flush_responses(req->client);
+}
+
+/**
+ * @brief Sends a content from memory.
+ *
+ * @param req     Pointer to the request, res->mime is set.
+ * @param code    Status of the response.
+ * @param content The content, it has to outlive the response.
+ * @param len     Length of the content.
+ */
+static void send_content(request_t *req, const llhttp_status_t code,
+                         const char *content, size_t len) {
+  response_t *res = &req->response;
+  res->size_content = len;
+  res->buf[0] = make_response_header(code, req);
+  res->buf[1] = uv_buf_init((char *)content, len);
+  res->header = res->buf[0].base;
+  // a response to HEAD carries no content
+  res->nbufs = req->method == HTTP_HEAD ? 1 : 2;
+  response_ready(req);
+}
+
+// bytes of a file compressed at once
+#define COMPRESS_CHUNK (64 * 1024)
+
+/*
+ * A content compressed on the threadpool, either a file read in chunks or a
+ * content in memory.
+ */
+typedef struct compress_job_s {
+  uv_work_t work;
+  request_t *req;
+  compressor_t compressor;
+  uv_file fd;             /* file to compress, -1 for content */
+  const char *content;    /* or the content in memory */
+  size_t size;            /* bytes to compress */
+  llhttp_status_t status; /* of the response */
+  int result;             /* of the compression, a libuv error code */
+} compress_job_t;
+
+static bool compressible_type(const webconfig_t *web_config,
+                              const char *mime) {
+  for (const char **type = web_config->compress_types;
+       type != NULL && *type != NULL; type++) {
+    if (strcasecmp(*type, mime) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Picks the encoding a content gets compressed with on the fly.
+ *
+ * @param req  Pointer to the request.
+ * @param mime Type of the content.
+ * @param size Size of the content.
+ *
+ * @return Returns the CONTENT_ENCODING_xxx, or 0 to send the content as is.
+ */
+static uint8_t content_compression(const request_t *req, const char *mime,
+                                   size_t size) {
+  const webconfig_t *web_config = req->client->worker->config;
+  if (web_config->compress_level == 0 || mime == NULL ||
+      size < web_config->compress_min_size ||
+      !compressible_type(web_config, mime)) {
+    return 0;
+  }
+  const uint8_t usable = req->accept_encodings & compressor_encodings();
+  for (int i = 0; i < num_content_encodings; i++) {
+    if (usable & content_encodings[i].bit) {
+      return content_encodings[i].bit;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Picks the encoding a file gets compressed with on the fly.
+ *
+ * Files larger than compress_max_size and ranges are sent as is.
+ *
+ * @return Returns the CONTENT_ENCODING_xxx, or 0 to send the file as is.
+ */
+static uint8_t file_compression(const request_t *req, const char *path,
+                                const uv_stat_t *stat) {
+  const webconfig_t *web_config = req->client->worker->config;
+  if ((req->method != HTTP_GET && req->method != HTTP_HEAD) ||
+      (uint64_t)stat->st_size > web_config->compress_max_size ||
+      request_header(req, "Range", NULL) != NULL) {
+    return 0;
+  }
+  return content_compression(
+      req, match_mime_type(req->client->worker, path)->content_type,
+      stat->st_size);
+}
+
+// key of a file compressed with res->content_encoding in the compressed cache
+static size_t make_compressed_key(const response_t *res, char *key) {
+  const fdcache_entry_t *file = res->file;
+  const uint64_t mtime = (uint64_t)file->stat.st_mtim.tv_sec * 1000000000 +
+                         file->stat.st_mtim.tv_nsec;
+  memcpy(key, file->path, file->length_path);
+  key[file->length_path] = '\0';
+  return file->length_path + 1 +
+         snprintf(key + file->length_path + 1, 64,
+                  "%" PRIx64 "-%" PRIx64 "-%s", mtime,
+                  (uint64_t)file->stat.st_size,
+                  find_content_encoding(res->content_encoding)->name);
+}
+
+static void compress_work(uv_work_t *work) {
+  compress_job_t *job = (compress_job_t *)work->data;
+  if (job->fd < 0) {
+    job->result =
+        compressor_write(&job->compressor, job->content, job->size, true);
+    return;
+  }
+
+  char *chunk = malloc(COMPRESS_CHUNK);
+  size_t offset = 0;
+  int r = chunk != NULL ? 0 : UV_ENOMEM;
+  while (r == 0 && offset < job->size) {
+    const size_t len = job->size - offset < COMPRESS_CHUNK
+                           ? job->size - offset
+                           : COMPRESS_CHUNK;
+    const ssize_t n = pread(job->fd, chunk, len, offset);
+    if (n <= 0) {
+      // failed or the file got shorter since stat
+      r = n < 0 ? uv_translate_sys_error(errno) : UV_EIO;
+      break;
+    }
+    offset += n;
+    r = compressor_write(&job->compressor, chunk, n, offset >= job->size);
+  }
+  free(chunk);
+  job->result = r;
+}
+
+static void send_cached_response(request_t *req, filecache_entry_t *entry);
+static void send_file_content(request_t *req);
+
+/**
+ * @brief Sends a compressed file, kept in the compressed cache.
+ *
+ * @return Returns 0 on success, or -1 if out of memory.
+ */
+static int send_compressed_file(request_t *req, compressor_t *compressor) {
+  worker_t *worker = req->client->worker;
+  response_t *res = &req->response;
+  char header[2048];
+  res->size_content = compressor->length_output;
+  const int length_header =
+      make_content_header(HTTP_STATUS_OK, req, header, sizeof(header));
+  char key[MAX_PATH_LENGTH + 64];
+  const size_t length_key = make_compressed_key(res, key);
+  filecache_entry_t *entry = filecache_entry_new(
+      key, length_key, header, length_header, compressor->length_output);
+  if (entry == NULL) {
+    return -1;
+  }
+  memcpy(entry->data + length_header + 2, compressor->output,
+         compressor->length_output);
+
+  fdcache_release(res->file);
+  res->file = NULL;
+  filecache_insert(&worker->compcache, entry, uv_now(worker->loop));
+  send_cached_response(req, entry);
+  return 0;
+}
+
+static void after_compress(uv_work_t *work, int status) {
+  compress_job_t *job = (compress_job_t *)work->data;
+  request_t *req = job->req;
+  response_t *res = &req->response;
+  const int result = status != 0 ? status : job->result;
+
+  if (request_is_orphan(req)) {
+    compressor_free(&job->compressor);
+    free(job);
+    return;
+  }
+  if (result == 0 && job->fd < 0) {
+    // the response keeps the compressed content
+    res->body = job->compressor.output;
+    job->compressor.output = NULL;
+    send_content(req, job->status, res->body, job->compressor.length_output);
+  } else if (result != 0 ||
+             send_compressed_file(req, &job->compressor) != 0) {
+    // sent as is
+    res->content_encoding = 0;
+    res->compressed = false;
+    if (job->fd < 0) {
+      send_content(req, job->status, job->content, job->size);
+    } else {
+      res->size_content = job->size;
+      send_file_content(req);
+    }
+  }
+  compressor_free(&job->compressor);
+  free(job);
+}
+
+/**
+ * @brief Compresses a file or a content with res->content_encoding on the
+ *        threadpool, the response is sent once done.
+ *
+ * @param req     Pointer to the request.
+ * @param fd      The file, -1 for a content.
+ * @param content The content, it has to outlive the response.
+ * @param size    Bytes to compress.
+ * @param status  Status of the response.
+ *
+ * @return Returns 0 if the compression is queued, or a libuv error code.
+ */
+static int start_compression(request_t *req, uv_file fd, const char *content,
+                             size_t size, llhttp_status_t status) {
+  const webconfig_t *web_config = req->client->worker->config;
+  compress_job_t *job = malloc(sizeof(compress_job_t));
+  if (job == NULL) {
+    return UV_ENOMEM;
+  }
+  int r = compressor_init(&job->compressor, req->response.content_encoding,
+                          web_config->compress_level, size);
+  if (r != 0) {
+    free(job);
+    return r;
+  }
+  job->work.data = job;
+  job->req = req;
+  job->fd = fd;
+  job->content = content;
+  job->size = size;
+  job->status = status;
+  job->result = 0;
+  r = uv_queue_work(req->client->worker->loop, &job->work, compress_work,
+                    after_compress);
+  if (r != 0) {
+    compressor_free(&job->compressor);
+    free(job);
+  }
+  return r;
+}
+
+/**
+ * @brief Builds the Date and Connection fields of a response otherwise
+ *        serialized in advance, in a header buffer of the worker.
+ *
+ * @return Returns the fields, to be set as res->header, or an empty buffer if
+ *         out of memory.
+ */
+static uv_buf_t make_response_fields(request_t *req) {
+  worker_t *worker = req->client->worker;
+  char *buf = pool_get(&worker->headers);
+  if (buf == NULL) {
+    return uv_buf_init(NULL, 0);
+  }
+  const int len = RESPONSE_HEADER_SIZE;
+  int cnt = make_header_date(worker, buf, len);
+  cnt += make_header_connection(req->response.keep_alive, buf + cnt, len - cnt);
+  return uv_buf_init(buf, cnt);
+}
+
+// the page of a status of error_page_statuses, the one of 500 for any other
+static const error_page_t *find_error_page(const worker_t *worker,
+                                           llhttp_status_t status) {
+  int i = 0;
+  while (i < NUM_ERROR_PAGES - 1 && error_page_statuses[i].status != status) {
+    i++;
+  }
+  return &worker->error_pages[i];
+}
+
+/**
+ * @brief Answers with the error page of a status, serialized at startup.
+ *
+ * @param req    Pointer to the request.
+ * @param status HTTP_STATUS_BAD_REQUEST, UNAUTHORIZED, NOT_FOUND or
+ *               INTERNAL_SERVER_ERROR.
+ */
+static void send_error_page(request_t *req, llhttp_status_t status) {
+  const error_page_t *page = find_error_page(req->client->worker, status);
+  response_t *res = &req->response;
+  res->buf[1] = make_response_fields(req);
+  if (res->buf[1].base == NULL) {
+    abort_response(req);
+    return;
+  }
+  res->header = res->buf[1].base;
+  res->buf[0] = uv_buf_init(page->data, page->length_header);
+  // a response to HEAD carries no content, only the end of the header
+  res->buf[2] = uv_buf_init(page->data + page->length_header,
+                            req->method == HTTP_HEAD
+                                ? 2
+                                : page->length - page->length_header);
+  res->nbufs = 3;
+  response_ready(req);
+}
+
+/**
+ * @brief Answers a request from an entry of the file cache.
+ *
+ * The entry holds everything but the Date and Connection fields, so the
+ * response is a single write straight from memory.
+ *
+ * @param req   Pointer to the request.
+ * @param entry The entry, the reference is handed over to the response.
+ */
+static void send_cached_response(request_t *req, filecache_entry_t *entry) {
+  response_t *res = &req->response;
+  res->buf[1] = make_response_fields(req);
+  if (res->buf[1].base == NULL) {
+    filecache_release(entry);
+    abort_response(req);
+    return;
+  }
+  res->header = res->buf[1].base;
+  res->cached = entry;
+  res->buf[0] = uv_buf_init(entry->data, entry->length_header);
+  // a response to HEAD carries no content, only the end of the header
+  res->buf[2] = uv_buf_init(entry->data + entry->length_header,
+                            req->method == HTTP_HEAD
+                                ? 2
+                                : entry->length_data - entry->length_header);
+  res->nbufs = 3;
+  response_ready(req);
+}
+
+static void read_cached_file(request_t *req);
+
+static void cached_file_read(request_t *req, ssize_t result) {
+  worker_t *worker = req->client->worker;
+  response_t *res = &req->response;
+  if (result <= 0) {
+    // failed or the file got shorter since stat
+    filecache_release(res->cached);
+    res->cached = NULL;
+    fdcache_release(res->file);
+    res->file = NULL;
+    send_error_page(req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+    return;
+  }
+
+  res->sent += result;
+  if (res->sent < res->size_content) {
+    read_cached_file(req);
+    return;
+  }
+
+  fdcache_release(res->file);
+  res->file = NULL;
+  res->sent = 0;
+
+  filecache_entry_t *entry = res->cached;
+  res->cached = NULL;
+  filecache_insert(&worker->filecache, entry, uv_now(worker->loop));
+  send_cached_response(req, entry);
+}
+
+static void on_cached_file_read(uv_fs_t *fs_req) {
+  request_t *req = (request_t *)fs_req->data;
+  const ssize_t result = fs_req->result;
+  uv_fs_req_cleanup(fs_req);
+  pool_put(&req->client->worker->fs_reqs, fs_req);
+
+  if (request_is_orphan(req)) {
+    return;
+  }
+  cached_file_read(req, result);
+}
+
+static void on_cached_file_uring_read(uring_req_t *ureq) {
+  request_t *req = (request_t *)ureq->data;
+  const ssize_t result = ureq->result;
+  uring_req_cleanup(ureq);
+  pool_put(&req->client->worker->uring_reqs, ureq);
+
+  if (request_is_orphan(req)) {
+    return;
+  }
+  cached_file_read(req, result);
+}
+
+static void read_cached_file(request_t *req) {
+  worker_t *worker = req->client->worker;
+  response_t *res = &req->response;
+  filecache_entry_t *entry = res->cached;
+  char *content = entry->data + entry->length_header + 2;
+  uv_buf_t buf = uv_buf_init(content + res->sent, res->size_content - res->sent);
+
+  if (worker->uring.active) {
+    uring_req_t *ureq = pool_get(&worker->uring_reqs);
+    if (ureq != NULL) {
+      ureq->data = req;
+      if (uring_read(&worker->uring, ureq, res->file->fd, buf.base, buf.len,
+                     res->sent, on_cached_file_uring_read) == 0) {
+        return;
+      }
+      pool_put(&worker->uring_reqs, ureq);
+    }
+  }
+
+  uv_fs_t *fs_req = pool_get(&worker->fs_reqs);
+  if (fs_req == NULL) {
+    cached_file_read(req, UV_ENOMEM);
+    return;
+  }
+  fs_req->data = req;
+  uv_fs_read(worker->loop, fs_req, res->file->fd, &buf, 1, res->sent,
+             on_cached_file_read);
+}
+
+/**
+ * @brief Makes the file cache key of a request.
+ *
+ * The response depends on the encodings the client accepts, the key is the
+ * URL followed by a NUL and the accepted encodings if there are any.
+ *
+ * @param req Pointer to the request.
+ * @param key Receives the key, MAX_PATH_LENGTH + 2 bytes.
+ *
+ * @return Returns the length of the key.
+ */
+static size_t make_cache_key(const request_t *req, char *key) {
+  memcpy(key, req->url, req->length_url);
+  if (req->accept_encodings == 0) {
+    return req->length_url;
+  }
+  key[req->length_url] = '\0';
+  key[req->length_url + 1] = (char)req->accept_encodings;
+  return req->length_url + 2;
+}
+
+/**
+ * @brief Loads a small file into a new entry of the file cache.
+ *
+ * The entry is used even if the cache doesn't keep it, the header and the
+ * content then still go out in a single write.
+ *
+ * @param req Pointer to the request, the file is open.
+ */
+static void load_cached_file(request_t *req) {
+  response_t *res = &req->response;
+  char header[2048];
+  const int length_header =
+      make_content_header(HTTP_STATUS_OK, req, header, sizeof(header));
+
+  char key[MAX_PATH_LENGTH + 2];
+  const size_t length_key = make_cache_key(req, key);
+  res->cached = filecache_entry_new(key, length_key, header, length_header,
+                                    res->size_content);
+  if (res->cached == NULL) {
+    res->buf[0] = make_response_header(HTTP_STATUS_OK, req);
+    res->header = res->buf[0].base;
+    res->nbufs = 1;
+    response_ready(req);
+    return;
+  }
+
+  res->sent = 0;
+  if (res->size_content == 0) {
+    // nothing to read
+    fdcache_release(res->file);
+    res->file = NULL;
+    filecache_entry_t *entry = res->cached;
+    res->cached = NULL;
+    filecache_insert(&req->client->worker->filecache, entry,
+                     uv_now(req->client->worker->loop));
+    send_cached_response(req, entry);
+    return;
+  }
+  read_cached_file(req);
+}
+
+static void resolve_path(request_t *req, const char *path, size_t len);
+
+/**
+ * @brief Looks up the next default file of a directory URL.
+ *
+ * @param req Pointer to the request, default_filename_tries counts the
+ *            default files tried so far.
+ */
+static void try_default_file(request_t *req) {
+  const webconfig_t *web_config = req->client->worker->config;
+  if (req->default_filename_tries >= web_config->def_cnt) {
+    send_error_page(req, HTTP_STATUS_NOT_FOUND);
+    return;
+  }
+
+  char path[MAX_PATH_LENGTH];
+  int len;
+  if (req->length_url > 1 && req->url[req->length_url - 1] != '/') {
+    len = snprintf(path, MAX_PATH_LENGTH, "%s%s/%s", web_config->www_root,
+                   req->url, web_config->defaults[req->default_filename_tries]);
+  } else {
+    len = snprintf(path, MAX_PATH_LENGTH, "%s%s%s", web_config->www_root,
+                   req->url, web_config->defaults[req->default_filename_tries]);
+  }
+  req->default_filename_tries++;
+  if (len >= MAX_PATH_LENGTH) {
+    send_error_page(req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+    return;
+  }
+
+  fprintf(stdout, "try to find default file:%s\n", path);
+  resolve_path(req, path, len);
+}
+
+static void send_file_entry(request_t *req, fdcache_entry_t *entry);
+
+static bool is_variant_path(const char *path, size_t len) {
+  for (int i = 0; i < num_content_encodings; i++) {
+    const size_t length_suffix = strlen(content_encodings[i].suffix);
+    if (len > length_suffix &&
+        strcmp(path + len - length_suffix, content_encodings[i].suffix) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Tells whether precompressed variants of a file are to be looked up.
+ *
+ * They are for a client accepting an encoding, unless the file is such a
+ * variant already or the lookup of the variants is under way.
+ */
+static bool wants_variant(const request_t *req, const char *path) {
+  return req->client->worker->config->precompressed &&
+         req->identity == NULL && req->tried_encodings == 0 &&
+         req->accept_encodings != 0 && !is_variant_path(path, strlen(path));
+}
+
+/**
+ * @brief Looks up the next precompressed variant of req->identity the client
+ *        accepts, or sends req->identity itself once none is left.
+ *
+ * @param req Pointer to the request.
+ */
+static void try_next_variant(request_t *req) {
+  const uint8_t left = req->accept_encodings & ~req->tried_encodings;
+  fdcache_entry_t *identity = req->identity;
+  const content_encoding_t *encoding = NULL;
+  for (int i = 0; i < num_content_encodings && encoding == NULL; i++) {
+    if (left & content_encodings[i].bit) {
+      encoding = &content_encodings[i];
+    }
+  }
+
+  char path[MAX_PATH_LENGTH];
+  const int len = encoding != NULL
+                      ? snprintf(path, MAX_PATH_LENGTH, "%s%s", identity->path,
+                                 encoding->suffix)
+                      : 0;
+  if (encoding == NULL || len >= MAX_PATH_LENGTH) {
+    req->tried_encodings = req->accept_encodings;
+    req->identity = NULL;
+    send_file_entry(req, identity);
+    return;
+  }
+  req->tried_encodings |= encoding->bit;
+  req->variant = encoding->bit;
+  resolve_path(req, path, len);
+}
+
+static void send_not_found(request_t *req) {
+  if (req->identity != NULL) {
+    // no such variant, the plain file is there
+    try_next_variant(req);
+  } else if (req->default_filename_tries > 0) {
+    try_default_file(req);
+  } else {
+    send_error_page(req, HTTP_STATUS_NOT_FOUND);
+  }
+}
+
+/**
+ * @brief Looks for an entity tag in the value of If-None-Match or If-Range.
+ *
+ * @param list   Comma separated entity tags, or "*".
+ * @param len    Length of the list.
+ * @param etag   The current entity tag of the file.
+ * @param strong true for the strong comparison, both tags must then be strong.
+ *
+ * @return Returns true if a tag of the list matches.
+ */
+static bool etag_matches(const char *list, uint32_t len, const char *etag,
+                         bool strong) {
+  if (len == 1 && list[0] == '*') {
+    return true;
+  }
+  const bool weak = etag[0] == 'W';
+  if (strong && weak) {
+    return false;
+  }
+  const char *opaque = weak ? etag + 2 : etag;
+  const size_t length_opaque = strlen(opaque);
+
+  const char *p = list;
+  const char *end = list + len;
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+      p++;
+    }
+    const char *tag = p;
+    while (p < end && *p != ',') {
+      p++;
+    }
+    const char *tag_end = p;
+    while (tag_end > tag && (tag_end[-1] == ' ' || tag_end[-1] == '\t')) {
+      tag_end--;
+    }
+    if (tag_end - tag > 2 && tag[0] == 'W' && tag[1] == '/') {
+      if (strong) {
+        continue;
+      }
+      tag += 2;
+    }
+    if ((size_t)(tag_end - tag) == length_opaque &&
+        memcmp(tag, opaque, length_opaque) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Evaluates If-None-Match and If-Modified-Since against a file.
+ *
+ * If-Modified-Since is ignored when If-None-Match is present (RFC 9110,
+ * section 13.2.2).
+ *
+ * @param req      Pointer to the request.
+ * @param stat     Stat of the file.
+ * @param encoding Compression of the content on the fly, see make_etag().
+ *
+ * @return Returns true if the client has the current content (304).
+ */
+static bool not_modified(const request_t *req, const uv_stat_t *stat,
+                         uint8_t encoding) {
+  if (req->method != HTTP_GET && req->method != HTTP_HEAD) {
+    return false;
+  }
+
+  uint32_t len;
+  const char *value = request_header(req, "If-None-Match", &len);
+  if (value != NULL) {
+    char etag[ETAG_SIZE];
+    make_etag(stat, encoding, etag);
+    return etag_matches(value, len, etag, false);
+  }
+  value = request_header(req, "If-Modified-Since", &len);
+  time_t date;
+  return value != NULL && http_date_parse(value, len, &date) &&
+         stat->st_mtim.tv_sec <= date;
+}
+
+static bool is_conditional(const request_t *req) {
+  return request_header(req, "If-None-Match", NULL) != NULL ||
+         request_header(req, "If-Modified-Since", NULL) != NULL;
+}
+
+/**
+ * @brief Answers Not Modified (304), with the validators of the file.
+ *
+ * @param req      Pointer to the request.
+ * @param stat     Stat of the file, the file doesn't need to be open.
+ * @param encoding Compression of the content on the fly, see make_etag().
+ */
+static void send_not_modified(request_t *req, const uv_stat_t *stat,
+                              uint8_t encoding) {
+  worker_t *worker = req->client->worker;
+  response_t *res = &req->response;
+  char *buf = pool_get(&worker->headers);
+  if (buf == NULL) {
+    send_error_page(req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+    return;
+  }
+  const int len = RESPONSE_HEADER_SIZE;
+  int cnt = make_header_status(HTTP_STATUS_NOT_MODIFIED, buf, len);
+  cnt += make_header_encoding(res, buf + cnt, len - cnt);
+  cnt += make_header_validators(worker, stat, encoding, buf + cnt, len - cnt);
+  cnt += make_header_date(worker, buf + cnt, len - cnt);
+  cnt += make_header_connection(res->keep_alive, buf + cnt, len - cnt);
+  cnt += snprintf(buf + cnt, len - cnt, "\r\n");
+
+  res->header = buf;
+  res->buf[0] = uv_buf_init(res->header, cnt);
+  res->nbufs = 1;
+  response_ready(req);
+}
+
+/**
+ * @brief Tells whether the If-Range of a request still matches the file.
+ *
+ * A request without If-Range always matches. An entity tag has to match
+ * strongly, a date has to be the one of the last modification.
+ */
+static bool if_range_matches(const request_t *req,
+                             const fdcache_entry_t *file) {
+  uint32_t len;
+  const char *value = request_header(req, "If-Range", &len);
+  if (value == NULL) {
+    return true;
+  }
+  if (len > 0 && (value[0] == '"' || value[0] == 'W')) {
+    char etag[ETAG_SIZE];
+    make_etag(&file->stat, 0, etag);
+    return etag_matches(value, len, etag, true);
+  }
+  time_t date;
+  return http_date_parse(value, len, &date) &&
+         date == file->stat.st_mtim.tv_sec;
+}
+
+/**
+ * @brief Lays out a multipart/byteranges response.
+ *
+ * res->parts gets the content type and its header line followed by the
+ * part header of every range, one more range without bytes carries the
+ * closing delimiter. res->mime becomes the multipart type.
+ *
+ * @param res   Pointer to the response, ranges and num_ranges are set.
+ * @param arena Arena of the request, holds the part headers.
+ * @param token Differs between the requests, makes the boundary.
+ *
+ * @return Returns 0 on success, or -1 if out of memory.
+ */
+static int make_multipart(response_t *res, arena_t *arena, uint64_t token) {
+  const mime_type_t *mime = res->mime;
+  const uint64_t size = res->file->stat.st_size;
+  const uint32_t count = res->num_ranges - 1;
+  const size_t capacity = 128 + (count + 1) * (mime->length_header + 128);
+  char boundary[17];
+  snprintf(boundary, sizeof(boundary), "%016" PRIx64, token);
+
+  mime_type_t *multipart = arena_alloc(arena, sizeof(mime_type_t));
+  res->parts = arena_alloc(arena, capacity);
+  if (multipart == NULL || res->parts == NULL) {
+    return -1;
+  }
+  multipart->content_type = res->parts;
+  size_t cnt = snprintf(res->parts, capacity,
+                        "multipart/byteranges; boundary=%s", boundary) +
+               1;
+  multipart->header = res->parts + cnt;
+  multipart->length_header =
+      snprintf(res->parts + cnt, capacity - cnt, "Content-Type: %s\r\n",
+               multipart->content_type);
+  cnt += multipart->length_header + 1;
+  res->mime = multipart;
+  res->size_content = 0;
+  for (uint32_t i = 0; i <= count; i++) {
+    range_t *range = &res->ranges[i];
+    int n;
+    if (i < count) {
+      // the CRLF before a delimiter belongs to it
+      n = snprintf(res->parts + cnt, capacity - cnt,
+                   "%s--%s\r\n%.*s"
+                   "Content-Range: bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64
+                   "\r\n\r\n",
+                   i > 0 ? "\r\n" : "", boundary, (int)mime->length_header,
+                   mime->header, range->start, range->end - 1, size);
+    } else {
+      range->start = range->end = 0;
+      n = snprintf(res->parts + cnt, capacity - cnt, "\r\n--%s--\r\n",
+                   boundary);
+    }
+    range->part_header = cnt;
+    range->length_part_header = n;
+    cnt += n;
+    res->size_content += n + (range->end - range->start);
+  }
+  return 0;
+}
+
+/**
+ * @brief Answers a GET with a Range header field with the ranges of a file.
+ *
+ * One range is sent as is, several ranges as multipart/byteranges. A Range
+ * that can't be parsed, asks for too many ranges or whose If-Range doesn't
+ * match is ignored.
+ *
+ * @param req Pointer to the request, the file of the response is set.
+ *
+ * @return Returns true if the request got a Partial Content (206) or a Range
+ *         Not Satisfiable (416) response, false if the whole file is to be
+ *         sent.
+ */
+static bool send_ranges(request_t *req) {
+  response_t *res = &req->response;
+  uint32_t len;
+  const char *value = request_header(req, "Range", &len);
+  if (value == NULL || !if_range_matches(req, res->file)) {
+    return false;
+  }
+
+  // room for the closing delimiter of a multipart response
+  range_t ranges[RANGE_MAX + 1];
+  const int count =
+      range_parse(value, len, res->file->stat.st_size, ranges, RANGE_MAX);
+  if (count < 0) {
+    return false;
+  }
+  if (count == 0) {
+    res->size_content = 0;
+    res->mime = NULL;
+    res->buf[0] =
+        make_response_header(HTTP_STATUS_RANGE_NOT_SATISFIABLE, req);
+    res->header = res->buf[0].base;
+    res->nbufs = 1;
+    fdcache_release(res->file);
+    res->file = NULL;
+    response_ready(req);
+    return true;
+  }
+
+  res->num_ranges = count > 1 ? count + 1 : 1;
+  res->ranges = arena_alloc(&req->arena, res->num_ranges * sizeof(range_t));
+  if (res->ranges == NULL) {
+    return false;
+  }
+  memcpy(res->ranges, ranges, count * sizeof(range_t));
+  if (count > 1 &&
+      make_multipart(res, &req->arena, uv_hrtime() ^ (uintptr_t)req) != 0) {
+    res->ranges = NULL;
+    res->num_ranges = 0;
+    return false;
+  }
+  if (count == 1) {
+    res->size_content = ranges[0].end - ranges[0].start;
+  }
+
+  res->range_index = 0;
+  res->sent = ranges[0].start;
+  res->send_end = ranges[0].end;
+  res->buf[0] = make_response_header(HTTP_STATUS_PARTIAL_CONTENT, req);
+  res->header = res->buf[0].base;
+  res->nbufs = 1;
+  if (count > 1) {
+    res->buf[1] = uv_buf_init(res->parts + res->ranges[0].part_header,
+                              res->ranges[0].length_part_header);
+    res->nbufs = 2;
+  }
+  response_ready(req);
+  return true;
+}
+
+/**
+ * @brief Sends the open file of a response as is, or the requested ranges.
+ *
+ * @param req Pointer to the request, the file of the response is set.
+ */
+static void send_file_content(request_t *req) {
+  response_t *res = &req->response;
+  if (req->method == HTTP_GET && send_ranges(req)) {
+    return;
+  }
+  if (req->method == HTTP_GET &&
+      res->size_content <= req->client->worker->config->filecache_max_file) {
+    load_cached_file(req);
+    return;
+  }
+
+  res->buf[0] = make_response_header(HTTP_STATUS_OK, req);
+  res->header = res->buf[0].base;
+  res->nbufs = 1;
+  response_ready(req);
+}
+
+/**
+ * @brief Sends a file compressed on the fly, from the compressed cache or
+ *        compressed on the threadpool first.
+ *
+ * @param req Pointer to the request, the file of the response is set.
+ */
+static void compress_file(request_t *req) {
+  worker_t *worker = req->client->worker;
+  response_t *res = &req->response;
+  char key[MAX_PATH_LENGTH + 64];
+  const size_t length_key = make_compressed_key(res, key);
+  filecache_entry_t *entry = filecache_lookup(&worker->compcache, key,
+                                              length_key, uv_now(worker->loop));
+  if (entry != NULL) {
+    fdcache_release(res->file);
+    res->file = NULL;
+    send_cached_response(req, entry);
+    return;
+  }
+
+  if (start_compression(req, res->file->fd, NULL, res->size_content,
+                        HTTP_STATUS_OK) != 0) {
+    // sent as is
+    res->content_encoding = 0;
+    res->compressed = false;
+    send_file_content(req);
+  }
+}
+
+/**
+ * @brief Answers a request with a file or a directory of the fd cache.
+ *
+ * A directory gets its default files looked up, a file is sent (or loaded
+ * into the file cache first).
+ *
+ * @param req   Pointer to the request.
+ * @param entry The entry, the reference is handed over to the request.
+ */
+static void send_file_entry(request_t *req, fdcache_entry_t *entry) {
+  response_t *res = &req->response;
+  if (!S_ISREG(entry->stat.st_mode) && !S_ISDIR(entry->stat.st_mode)) {
+    // known to be missing
+    fdcache_release(entry);
+    send_not_found(req);
+    return;
+  }
+  if (S_ISDIR(entry->stat.st_mode)) {
+    fdcache_release(entry);
+    if (req->identity != NULL) {
+      // a directory named like a variant
+      try_next_variant(req);
+    } else {
+      // also skips a default file being a directory itself
+      try_default_file(req);
+    }
+    return;
+  }
+  if (wants_variant(req, entry->path)) {
+    // kept by the request while the variants are looked up
+    req->identity = entry;
+    try_next_variant(req);
+    return;
+  }
+
+  if (req->identity != NULL) {
+    // the variant is served with the type of the plain file
+    res->content_encoding = req->variant;
+    res->mime = match_mime_type(req->client->worker, req->identity->path);
+    fdcache_release(req->identity);
+    req->identity = NULL;
+  } else {
+    res->mime = match_mime_type(req->client->worker, entry->path);
+    res->content_encoding = file_compression(req, entry->path, &entry->stat);
+    res->compressed = res->content_encoding != 0;
+  }
+  const uint8_t encoding = res->compressed ? res->content_encoding : 0;
+  if (not_modified(req, &entry->stat, encoding)) {
+    send_not_modified(req, &entry->stat, encoding);
+    fdcache_release(entry);
+    return;
+  }
+
+  res->file = entry;
+  res->size_content = entry->stat.st_size;
+  // only the header for HEAD
+  res->sent = 0;
+  res->send_end = req->method == HTTP_HEAD ? 0 : res->size_content;
+  if (res->compressed) {
+    compress_file(req);
+    return;
+  }
+  send_file_content(req);
+}
+
+static void on_file_open(uv_fs_t *fs_req) {
+  request_t *req = (request_t *)fs_req->data;
+  worker_t *worker = req->client->worker;
+  response_t *res = &req->response;
+  const ssize_t result = fs_req->result;
+  uv_fs_req_cleanup(fs_req);
+  pool_put(&worker->fs_reqs, fs_req);
+
+  // the entry owns the file from now on, even for an orphan request
+  fdcache_entry_t *entry = res->file;
+  if (result >= 0) {
+    entry->fd = result;
+  }
+  if (request_is_orphan(req)) {
+    return;
+  }
+  res->file = NULL;
+  if (result < 0) {
+    fdcache_release(entry);
+    send_error_page(req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+    return;
+  }
+
+  fdcache_insert(&worker->fdcache, entry, uv_now(worker->loop));
+  send_file_entry(req, entry);
+}
+
+/**
+ * @brief Carries on once a path has been looked up.
+ *
+ * Revalidates the stale entry of the path kept in req->response.file, or
+ * makes a new entry and opens the file if it isn't yet.
+ *
+ * @param req    Pointer to the request.
+ * @param path   Filesystem path.
+ * @param result Result of the lookup, negative on failure.
+ * @param stat   Stat of the path.
+ * @param fd     The opened file, -1 if the path still has to be opened.
+ */
+static void on_path_found(request_t *req, const char *path, ssize_t result,
+                          const uv_stat_t *stat, uv_file fd) {
+  worker_t *worker = req->client->worker;
+  response_t *res = &req->response;
+
+  // the stale entry of the path, if any
+  fdcache_entry_t *entry = res->file;
+  res->file = NULL;
+  const size_t len = strlen(path);
+  if (entry != NULL) {
+    if ((result >= 0 && fdcache_same_file(entry, stat)) ||
+        (result == UV_ENOENT && entry->stat.st_mode == 0)) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      fdcache_revalidate(&worker->fdcache, entry, uv_now(worker->loop));
+      send_file_entry(req, entry);
+      return;
+    }
+    fdcache_remove(&worker->fdcache, path, len);
+    fdcache_release(entry);
+  }
+
+  if (result == UV_ENOENT) {
+    // remembered, the precompressed variants are mostly missing
+    uv_stat_t missing;
+    memset(&missing, 0, sizeof(missing));
+    entry = fdcache_entry_new(path, len, -1, &missing);
+    if (entry != NULL) {
+      fdcache_insert(&worker->fdcache, entry, uv_now(worker->loop));
+      fdcache_release(entry);
+    }
+  }
+  if (result < 0 || !(S_ISREG(stat->st_mode) || S_ISDIR(stat->st_mode))) {
+    // a fifo or a device isn't served, opening it could block a thread
+    if (fd >= 0) {
+      close(fd);
+    }
+    send_not_found(req);
+    return;
+  }
+
+  if (S_ISDIR(stat->st_mode) && fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  const uint8_t encoding =
+      req->identity == NULL ? file_compression(req, path, stat) : 0;
+  if (S_ISREG(stat->st_mode) && fd < 0 && !wants_variant(req, path) &&
+      not_modified(req, stat, encoding)) {
+    // no need to open the file for the validators
+    send_not_modified(req, stat, encoding);
+    return;
+  }
+  entry = fdcache_entry_new(path, len, fd, stat);
+  if (entry == NULL) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    send_error_page(req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+  } else if (S_ISDIR(stat->st_mode) || fd >= 0) {
+    fdcache_insert(&worker->fdcache, entry, uv_now(worker->loop));
+    send_file_entry(req, entry);
+  } else {
+    // kept by the request until the file is open
+    res->file = entry;
+    uv_fs_t *open_req = pool_get(&worker->fs_reqs);
+    if (open_req == NULL) {
+      res->file = NULL;
+      fdcache_release(entry);
+      send_error_page(req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+      return;
+    }
+    open_req->data = req;
+    uv_fs_open(worker->loop, open_req, path, O_RDONLY, 0, on_file_open);
+  }
+}
+
+static void on_path_stat(uv_fs_t *fs_req) {
+  request_t *req = (request_t *)fs_req->data;
+  worker_t *worker = req->client->worker;
+  if (!request_is_orphan(req)) {
+    on_path_found(req, fs_req->path, fs_req->result, &fs_req->statbuf, -1);
+  }
+  uv_fs_req_cleanup(fs_req);
+  pool_put(&worker->fs_reqs, fs_req);
+}
+
+static void on_path_open_stat(uring_req_t *ureq) {
+  request_t *req = (request_t *)ureq->data;
+  worker_t *worker = req->client->worker;
+  const uv_file fd = ureq->result >= 0 ? ureq->result : -1;
+  if (request_is_orphan(req)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  } else {
+    on_path_found(req, ureq->path, ureq->result, &ureq->statbuf, fd);
+  }
+  uring_req_cleanup(ureq);
+  pool_put(&worker->uring_reqs, ureq);
+}
+
+static void on_path_uring_stat(uring_req_t *ureq) {
+  request_t *req = (request_t *)ureq->data;
+  worker_t *worker = req->client->worker;
+  if (!request_is_orphan(req)) {
+    on_path_found(req, ureq->path, ureq->result, &ureq->statbuf, -1);
+  }
+  uring_req_cleanup(ureq);
+  pool_put(&worker->uring_reqs, ureq);
+}
+
+/**
+ * @brief Finds the file or directory of a path.
+ *
+ * A valid entry of the fd cache is used right away, a stale entry is checked
+ * with a stat, and anything else is looked up and opened in the threadpool.
+ * With io_uring the stat and the open are submitted together, except for a
+ * conditional request, which likely needs no open.
+ *
+ * @param req  Pointer to the request.
+ * @param path Filesystem path.
+ * @param len  Length of the path.
+ */
+static void resolve_path(request_t *req, const char *path, size_t len) {
+  worker_t *worker = req->client->worker;
+  bool stale = false;
+  fdcache_entry_t *entry = fdcache_lookup(&worker->fdcache, path, len,
+                                          uv_now(worker->loop), &stale);
+  if (entry != NULL && !stale) {
+    send_file_entry(req, entry);
+    return;
+  }
+
+  // a stale entry is kept by the request until the stat tells
+  req->response.file = entry;
+  if (worker->uring.active) {
+    uring_req_t *ureq = pool_get(&worker->uring_reqs);
+    if (ureq != NULL) {
+      ureq->data = req;
+      const int r =
+          entry != NULL || is_conditional(req)
+              ? uring_stat(&worker->uring, ureq, path, on_path_uring_stat)
+              : uring_open_stat(&worker->uring, ureq, path, on_path_open_stat);
+      if (r == 0) {
+        return;
+      }
+      pool_put(&worker->uring_reqs, ureq);
+    }
+  }
+
+  uv_fs_t *fs_req = pool_get(&worker->fs_reqs);
+  if (fs_req == NULL) {
+    req->response.file = NULL;
+    fdcache_release(entry);
+    send_error_page(req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+    return;
+  }
+  fs_req->data = req;
+  uv_fs_stat(worker->loop, fs_req, path, on_path_stat);
+}
+
+/**
+ * @brief Tells which encodings of the precompressed variants a client
+ *        accepts.
+ *
+ * Only the exclusion with q=0 is taken into account, the variants are
+ * preferred in the order of content_encodings otherwise.
+ *
+ * @return Returns the CONTENT_ENCODING_xxx bits.
+ */
+static uint8_t accepted_encodings(const request_t *req) {
+  uint32_t len;
+  const char *value = request_header(req, "Accept-Encoding", &len);
+  if (value == NULL) {
+    return 0;
+  }
+
+  uint8_t accepted = 0, refused = 0;
+  bool any = false;
+  const char *p = value;
+  const char *end = value + len;
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+      p++;
+    }
+    const char *name = p;
+    while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+      p++;
+    }
+    const size_t length_name = p - name;
+    // q=0, q=0.0 ... mean not acceptable
+    bool zero = false;
+    while (p < end && *p != ',') {
+      if ((*p == 'q' || *p == 'Q') && p + 1 < end && p[1] == '=') {
+        const char *q = p + 2;
+        zero = q < end && *q == '0';
+        for (q++; zero && q < end && *q != ',' && *q != ';'; q++) {
+          zero = *q == '.' || *q == '0' || *q == ' ' || *q == '\t';
+        }
+      }
+      p++;
+    }
+
+    if (length_name == 1 && name[0] == '*') {
+      any = !zero;
+      continue;
+    }
+    for (int i = 0; i < num_content_encodings; i++) {
+      const char *coding = content_encodings[i].name;
+      if (strlen(coding) == length_name &&
+          strncasecmp(name, coding, length_name) == 0) {
+        if (zero) {
+          refused |= content_encodings[i].bit;
+        } else {
+          accepted |= content_encodings[i].bit;
+        }
+      }
+    }
+  }
+  if (any) {
+    for (int i = 0; i < num_content_encodings; i++) {
+      accepted |= content_encodings[i].bit;
+    }
+  }
+  return accepted & ~refused;
+}
+
+static void process_request(request_t *req) {
+  worker_t *worker = req->client->worker;
+  const webconfig_t *web_config = worker->config;
+  if (req->url == NULL) {
+    send_error_page(req, HTTP_STATUS_BAD_REQUEST);
+    return;
+  }
+  fprintf(stdout, "Parse pass, method:%d, url: %s\n", req->method, req->url);
+
+  if (web_config->precompressed || web_config->compress_level > 0) {
+    req->accept_encodings = accepted_encodings(req);
+    req->response.vary_encoding = true;
+  }
+
+  // an entry holds the whole response, ranges are sent from the file and the
+  // validators come from the stat of the file
+  filecache_entry_t *entry = NULL;
+  if (!is_conditional(req) &&
+      (req->method != HTTP_GET || request_header(req, "Range", NULL) == NULL)) {
+    char key[MAX_PATH_LENGTH + 2];
+    const size_t length_key = make_cache_key(req, key);
+    entry = filecache_lookup(&worker->filecache, key, length_key,
+                             uv_now(worker->loop));
+  }
+  if (entry != NULL) {
+    send_cached_response(req, entry);
     return;
-  } else {
-    // found a file
-    res->size_content = fs_req->statbuf.st_size;
-    res->path_content = strdup(fs_req->path);
-    res->mime_content = match_mime_type(fs_req->path);
-    found_and_sendfs_req(client);
   }
 
-  uv_fs_req_cleanup(fs_req);
-  free(fs_req);
-}
-
-static void process_request(llhttp_t *parser, client_t *client) {
-  request_t *req = &client->request;
-  response_t *res = &client->response;
-  fprintf(stdout, "Parse pass, type:%d, method:%d, url: %s\n", parser->type,
-          parser->method, req->url);
-
   char path[MAX_PATH_LENGTH];
-
-  res->length_path =
+  const int len =
       snprintf(path, MAX_PATH_LENGTH, "%s%s", web_config->www_root, req->url);
-  if (res->length_path >= MAX_PATH_LENGTH) {
-    send_html_response(client, HTTP_STATUS_INTERNAL_SERVER_ERROR,
-                       res500content);
+  if (len >= MAX_PATH_LENGTH) {
+    send_error_page(req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
     return;
   }
-
-  uv_fs_t *fs_req = malloc(sizeof(uv_fs_t));
-  fs_req->data = client;
-  uv_fs_stat(loop, fs_req, path, check_path_async);
+  resolve_path(req, path, len);
 }
 
 // Callback to handle HTTP method
 int on_message_begin(llhttp_t *parser) {
+  client_t *client = (client_t *)parser->data;
   printf("on_message_begin HTTP method: %ul\n", parser->method);
-  return 0;
+  if (client_is_closing(client)) {
+    // no request is dispatched on a closing client, nothing would release it
+    return HPE_PAUSED;
+  }
+  client->parsing = create_request(client);
+  return client->parsing != NULL ? 0 : -1;
 }
 
 // Main callback to handle request complete
 static int on_message_complete(llhttp_t *parser) {
-  UNUSED(parser);
+  client_t *client = (client_t *)parser->data;
+  const webconfig_t *web_config = client->worker->config;
+  request_t *req = client->parsing;
   printf("Request complete\n");
-  return 0;
-}
-
-static void parse_get_url(const char *url, UT_array *array) {
-  char *token;
-  // Make a copy to avoid modifying the original string
-  char *url_copy = strdup(url);
-  char *saveptr;
-
-  token = strtok_r(url_copy, "&", &saveptr); // Split the string by '&'
 
-  while (token != NULL) {
-    char *param_name =
-        strtok(token, "="); // Split each token by '=' to get parameter name
-    char *param_value = strtok(NULL, "="); // Get parameter value
-
-    if (param_name != NULL && param_value != NULL) {
-      get_param_t param;
-      param.name = strdup(param_name);
-      param.value = strdup(param_value);
-      utarray_push_back(array, &param);
+  client->parsing = NULL;
+  if (client_is_closing(client)) {
+    if (req != NULL) {
+      free_request(req);
     }
-
-    token = strtok_r(NULL, "&", &saveptr);
+    return HPE_PAUSED;
   }
-
-  free(url_copy); // Free the memory allocated for the copied string
+  client->num_requests++;
+  req->method = parser->method;
+  req->response.keep_alive =
+      web_config->keepalive_timeout > 0 && llhttp_should_keep_alive(parser) &&
+      (web_config->keepalive_requests == 0 ||
+       client->num_requests < web_config->keepalive_requests);
+
+  uv_timer_stop(&client->idle_timer);
+  DL_APPEND(client->requests, req);
+  client->num_queued++;
+  client->refcount++;
+  // the response may be sent and the request released right away
+  const bool keep_alive = req->response.keep_alive;
+  process_request(req);
+
+  // hold the parser after the last request, while the pipeline is full or
+  // once the response got aborted
+  if (!keep_alive || client->num_queued >= web_config->pipeline_depth ||
+      client_is_closing(client)) {
+    return HPE_PAUSED;
+  }
+  return 0;
 }
 
-// Callback to handle URL
+// Callback to handle URL, the target may arrive in several chunks
 int on_url(llhttp_t *parser, const char *at, size_t length) {
   client_t *client = (client_t *)parser->data;
-  if (client->request.url != (char *)NULL)
-    free(client->request.url);
+  request_t *req = client->parsing;
+  if (req->length_url + length > MAX_URL_SIZE) {
+    return -1;
+  }
+  char *url = arena_realloc(&req->arena, req->url, req->length_url,
+                            req->length_url + length + 1);
+  if (url == NULL) {
+    return -1;
+  }
+  memcpy(url + req->length_url, at, length);
+  req->length_url += length;
+  url[req->length_url] = '\0';
+  req->url = url;
+  return 0;
+}
 
-  char *path = strndup(at, length);
-  const char *question = strchr(path, '?');
-  char *url = NULL;
+// Callback when the URL is complete, splits off the query and normalizes
+// the path
+static int on_url_complete(llhttp_t *parser) {
+  client_t *client = (client_t *)parser->data;
+  request_t *req = client->parsing;
+  if (req->url == NULL) {
+    return 0;
+  }
+  char *question = memchr(req->url, '?', req->length_url);
   if (question != NULL) {
-    const int len = question - path;
-    char *t_url = (char *)malloc(len + 1);
-    strncpy(t_url, path, len);
-    t_url[len] = '\0';
-    url = validate_and_normalize_path(t_url);
-    free(t_url);
-    utarray_new(client->request.query_param, &get_params_icd);
-    parse_get_url(question + 1, client->request.query_param);
-    free(path);
-  } else {
-    url = validate_and_normalize_path(path);
-    free(path);
+    query_init(&req->query, question + 1,
+               req->url + req->length_url - (question + 1));
+    req->length_url = question - req->url;
   }
 
-  if (url != NULL) {
-    path = strdup(url);
-    free(url);
-    client->request.length_url = (uint32_t)strlen(path);
-    client->request.url = path;
+  // the query stays as is behind the path
+  const int length = url_normalize_path(req->url, req->length_url);
+  if (length > 0 && length < MAX_PATH_LENGTH) {
+    req->length_url = (uint32_t)length;
   } else {
-    client->request.url = strdup("/");
-    client->request.length_url = strlen(client->request.url);
+    req->url = NULL;
+    req->length_url = 0;
   }
   return 0;
 }
@@ -655,48 +2569,266 @@ int on_status(llhttp_t *parser, const char *at, size_t length) {
   return 0;
 }
 
+static header_entry_t *header_slot(const request_t *req, uint32_t index) {
+  return index < REQUEST_INLINE_HEADERS
+             ? (header_entry_t *)&req->headers[index]
+             : &req->more_headers[index - REQUEST_INLINE_HEADERS];
+}
+
+/**
+ * @brief Gets the header field being parsed, the spilled fields get room
+ *        when the inline ones are used up.
+ *
+ * @return Returns the field, or NULL if out of memory or the request has more
+ *         than MAX_HEADERS fields.
+ */
+static header_entry_t *parsing_header(request_t *req) {
+  const uint32_t index = req->num_headers;
+  if (index >= MAX_HEADERS) {
+    return NULL;
+  }
+  if (index >= REQUEST_INLINE_HEADERS + req->capacity_more_headers) {
+    const uint32_t capacity = req->capacity_more_headers > 0
+                                  ? req->capacity_more_headers * 2
+                                  : REQUEST_INLINE_HEADERS;
+    header_entry_t *headers = arena_realloc(
+        &req->arena, req->more_headers,
+        req->capacity_more_headers * sizeof(header_entry_t),
+        capacity * sizeof(header_entry_t));
+    if (headers == NULL) {
+      return NULL;
+    }
+    memset(headers + req->capacity_more_headers, 0,
+           (capacity - req->capacity_more_headers) * sizeof(header_entry_t));
+    req->more_headers = headers;
+    req->capacity_more_headers = capacity;
+  }
+  return header_slot(req, index);
+}
+
+/**
+ * @brief Appends a chunk of a header field or value of the request being
+ *        parsed.
+ *
+ * The chunks of a field follow each other in the read buffer even if split
+ * across reads, so the slice just grows.
+ *
+ * @return Returns 0 on success, or -1 if the header fields of the request get
+ *         larger than MAX_HEADERS_SIZE.
+ */
+static int append_header_slice(request_t *req, uint32_t *offset,
+                               uint32_t *length, const char *at, size_t len) {
+  client_t *client = req->client;
+  if (req->length_headers + len > MAX_HEADERS_SIZE) {
+    return -1;
+  }
+  if (req->rbuf == NULL) {
+    req->rbuf = client->rbuf;
+    req->rbuf->refcount++;
+  }
+  const uint32_t start = at - req->rbuf->data;
+  if (*length == 0) {
+    *offset = start;
+  } else if (*offset + *length != start) {
+    return -1;
+  }
+  *length += len;
+  req->length_headers += len;
+  return 0;
+}
+
 // Callback to handle header field
 int on_header_field(llhttp_t *parser, const char *at, size_t length) {
-  UNUSED(parser);
-  // printf("Header field: %.*s\n", (int)length, at);
-  return 0;
+  client_t *client = (client_t *)parser->data;
+  request_t *req = client->parsing;
+  header_entry_t *header = parsing_header(req);
+  if (header == NULL) {
+    return -1;
+  }
+  return append_header_slice(req, &header->field, &header->length_field, at,
+                             length);
 }
 
 // Callback to handle header value
 int on_header_value(llhttp_t *parser, const char *at, size_t length) {
-  UNUSED(parser);
-  // printf("Header value: %.*s\n", (int)length, at);
+  client_t *client = (client_t *)parser->data;
+  request_t *req = client->parsing;
+  header_entry_t *header = header_slot(req, req->num_headers);
+  return append_header_slice(req, &header->value, &header->length_value, at,
+                             length);
+}
+
+static int on_header_value_complete(llhttp_t *parser) {
+  client_t *client = (client_t *)parser->data;
+  request_t *req = client->parsing;
+  header_entry_t *header = header_slot(req, req->num_headers);
+  // an empty value gets no on_header_value()
+  const char *value = req->rbuf->data + header->value;
+  while (header->length_value > 0 &&
+         (value[header->length_value - 1] == ' ' ||
+          value[header->length_value - 1] == '\t')) {
+    header->length_value--;
+  }
+  req->num_headers++;
   return 0;
 }
 
+const char *request_header(const request_t *req, const char *name,
+                           uint32_t *len) {
+  const size_t length_name = strlen(name);
+  // the last one received wins
+  for (uint32_t i = req->num_headers; i-- > 0;) {
+    const header_entry_t *header = header_slot(req, i);
+    if (header->length_field == length_name &&
+        strncasecmp(req->rbuf->data + header->field, name, length_name) ==
+            0) {
+      if (len != NULL) {
+        *len = header->length_value;
+      }
+      return req->rbuf->data + header->value;
+    }
+  }
+  return NULL;
+}
+
+const char *request_query_get(request_t *req, const char *name,
+                              uint32_t *len) {
+  return query_get(&req->query, &req->arena, name, len);
+}
+
+const query_param_t *request_query_next(request_t *req, uint32_t *index) {
+  return query_next(&req->query, &req->arena, index);
+}
+
 static int on_headers_complete(llhttp_t *parser) {
-  UNUSED(parser);
+  client_t *client = (client_t *)parser->data;
+  client->parsing->headers_complete = true;
   printf("Headers complete\n");
   return 0;
 }
 
 static int on_body(llhttp_t *parser, const char *at, size_t length) {
   client_t *client = (client_t *)parser->data;
+  request_t *req = client->parsing;
   if (at != NULL && length > 0) {
-    client->request.body = strndup(at, length);
-    client->request.length_body = length;
+    // the body may arrive in several chunks
+    if (req->length_body + length + 1 > req->capacity_body) {
+      size_t capacity =
+          req->capacity_body > 0 ? req->capacity_body : BODY_MIN_CAPACITY;
+      while (capacity < req->length_body + length + 1) {
+        capacity *= 2;
+      }
+      char *body =
+          arena_realloc(&req->arena, req->body, req->capacity_body, capacity);
+      if (body == NULL)
+        return -1;
+      req->body = body;
+      req->capacity_body = capacity;
+    }
+    memcpy(req->body + req->length_body, at, length);
+    req->length_body += length;
+    req->body[req->length_body] = '\0';
   }
   return 0;
 }
 
+/**
+ * @brief Makes room for a read in the read buffer of a client.
+ *
+ * The bytes nothing refers to anymore are dropped. The header of the request
+ * being parsed is kept and its slices moved along, the buffer is compacted
+ * in place if no other request refers to it, or replaced by a new one.
+ *
+ * @return Returns the buffer, or NULL if out of memory or the header of the
+ *         request being parsed gets larger than READ_BUFFER_MAX.
+ */
+static read_buffer_t *prepare_read_buffer(client_t *client) {
+  read_buffer_t *rbuf = client->rbuf;
+  if (rbuf != NULL && rbuf->capacity - rbuf->length >= READ_BUFFER_MIN_FREE) {
+    return rbuf;
+  }
+
+  request_t *req = client->parsing;
+  const bool pinned =
+      req != NULL && req->rbuf != NULL && !req->headers_complete;
+  uint32_t keep = client->parsed;
+  if (pinned && header_slot(req, 0)->field < keep) {
+    keep = header_slot(req, 0)->field;
+  }
+  const uint32_t length = rbuf != NULL ? rbuf->length - keep : 0;
+  if (length + READ_BUFFER_MIN_FREE > READ_BUFFER_MAX) {
+    return NULL;
+  }
+
+  if (rbuf != NULL && rbuf->refcount == (pinned ? 2u : 1u) &&
+      length + READ_BUFFER_MIN_FREE <= rbuf->capacity) {
+    memmove(rbuf->data, rbuf->data + keep, length);
+  } else {
+    read_buffer_t *fresh =
+        read_buffer_new(client->worker, length + READ_BUFFER_MIN_FREE);
+    if (fresh == NULL) {
+      return NULL;
+    }
+    if (length > 0) {
+      memcpy(fresh->data, rbuf->data + keep, length);
+    }
+    if (pinned) {
+      read_buffer_release(req->rbuf);
+      req->rbuf = fresh;
+      fresh->refcount++;
+    }
+    read_buffer_release(rbuf);
+    client->rbuf = rbuf = fresh;
+  }
+
+  if (pinned) {
+    // the field being parsed as well
+    const uint32_t slots = REQUEST_INLINE_HEADERS + req->capacity_more_headers;
+    for (uint32_t i = 0; i <= req->num_headers && i < slots; i++) {
+      header_entry_t *header = header_slot(req, i);
+      header->field -= header->length_field > 0 ? keep : 0;
+      header->value -= header->length_value > 0 ? keep : 0;
+    }
+  }
+  rbuf->length = length;
+  client->parsed -= keep;
+  return rbuf;
+}
+
+/**
+ * @brief Lets go of the read buffer of a client once all its bytes are
+ *        parsed and no request being parsed refers to it.
+ */
+static void trim_read_buffer(client_t *client) {
+  const request_t *req = client->parsing;
+  if (client->rbuf == NULL || client->parsed < client->rbuf->length ||
+      (req != NULL && req->rbuf != NULL && !req->headers_complete)) {
+    return;
+  }
+  read_buffer_release(client->rbuf);
+  client->rbuf = NULL;
+  client->parsed = 0;
+}
+
 static void on_alloc(uv_handle_t *handle, size_t suggested_size,
                      uv_buf_t *buf) {
-  UNUSED(handle);
-  *buf = uv_buf_init((char *)malloc(suggested_size), suggested_size);
+  UNUSED(suggested_size);
+  client_t *client = (client_t *)handle->data;
+  read_buffer_t *rbuf = prepare_read_buffer(client);
+  if (rbuf == NULL) {
+    // on_read() gets UV_ENOBUFS
+    *buf = uv_buf_init(NULL, 0);
+    return;
+  }
+  *buf = uv_buf_init(rbuf->data + rbuf->length, rbuf->capacity - rbuf->length);
 }
 
-static void on_close(uv_handle_t *handle) {
+static void on_handle_close(uv_handle_t *handle) {
   client_t *client = (client_t *)(handle->data);
-  CLIENT_CLEAR_IN_USE(client);
-  if (CLIENT_IS_FLAGS_FREE(client)) {
-    LL_DELETE(activeClientList, client);
-    free_client(client);
+  if (--client->closing_handles > 0) {
+    return;
   }
+  release_client(client);
 }
 
 static void on_write(uv_write_t *req, int status) {
@@ -711,47 +2843,44 @@ static void on_write(uv_write_t *req, int status) {
 }
 
 // Callback to handle HTTP request data
-void on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+static void on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
   const uv_tcp_t *handle = (uv_tcp_t *)stream;
   client_t *client = (client_t *)(handle->data);
 
+  UNUSED(buf);
   if (nread < 0) { // Error or EOF
+    if (nread == UV_EOF && client->requests != NULL) {
+      // answer the pipelined requests before closing
+      client->eof = true;
+      uv_read_stop(stream);
+      return;
+    }
     if (nread != UV_EOF) {
       fprintf(stderr, "Read error %s\n", uv_strerror(nread));
     }
     fprintf(stdout, "UV_EOF, close the connection\n\n");
-    uv_close((uv_handle_t *)&client->handle, (uv_close_cb)on_close);
-    free(buf->base);
-    return;
-  }
-
-  if (nread == 0) {
-    uv_close((uv_handle_t *)&client->handle, (uv_close_cb)on_close);
+    close_client(client);
     return;
   }
 
-  llhttp_t *parser = &client->parser;
-  // Parse the received data
-  enum llhttp_errno err = llhttp_execute(parser, buf->base, nread);
-  if (err != HPE_OK) {
-    fprintf(stderr, "Parse error: %s %s\n", llhttp_errno_name(err),
-            client->parser.reason);
-    uv_close((uv_handle_t *)&client->handle, (uv_close_cb)on_close);
-    free(buf->base);
-    return;
+  // nread == 0 is EAGAIN, nothing to parse
+  if (nread > 0) {
+    client->rbuf->length += nread;
+    parse_request_data(client);
   }
-
-  client->request.method = parser->method;
-  // parsed successfully
-  process_request(parser, client);
-  free(buf->base);
+  trim_read_buffer(client);
 }
 
-static client_t *createClient(void) {
-  client_t *client = (client_t *)calloc(1, sizeof(client_t));
+static client_t *createClient(worker_t *worker) {
+  client_t *client = (client_t *)pool_get(&worker->clients);
   if (client != NULL) {
-    CLIENT_SET_IN_USE(client);
-    LL_APPEND(activeClientList, client);
+    memset(client, 0, sizeof(client_t));
+    client->worker = worker;
+    client->writable_fd = -1;
+    client->pipe_fds[0] = -1;
+    client->pipe_fds[1] = -1;
+    client->refcount = 1; /* the handles */
+    DL_APPEND(worker->activeClientList, client);
     return client;
   }
   return NULL;
@@ -774,15 +2903,19 @@ static void on_connection(uv_stream_t *server, int status) {
     return;
   }
 
-  client_t *client = createClient();
-  uv_tcp_init(loop, &client->handle);
-  llhttp_init(&client->parser, HTTP_REQUEST, &settings);
+  worker_t *worker = (worker_t *)server->data;
+  client_t *client = createClient(worker);
+  uv_tcp_init(worker->loop, &client->handle);
+  uv_timer_init(worker->loop, &client->idle_timer);
+  llhttp_init(&client->parser, HTTP_REQUEST, &worker->settings);
   client->handle.data = client;
+  client->idle_timer.data = client;
   client->parser.data = client;
   if (uv_accept(server, (uv_stream_t *)client) == 0) {
-    uv_read_start((uv_stream_t *)&(client->handle), on_alloc, on_read);
+    wait_request(client);
+    uv_read_start((uv_stream_t *)&client->handle, on_alloc, on_read);
   } else {
-    uv_close((uv_handle_t *)&(client->handle), (uv_close_cb)on_close);
+    close_client(client);
     fprintf(stderr, "New connection error %s\n", uv_strerror(status));
   }
 }
@@ -796,8 +2929,77 @@ static void walk_cb(uv_handle_t *handle, void *arg) {
 
 static void signal_handler(uv_signal_t *handle, int signum) {
   UNUSED(signum);
-  uv_stop(loop);
+  webserver_t *ws = (webserver_t *)handle->data;
+  // the worker threads get stopped once the loop of the caller returns
+  uv_stop(ws->loop);
+}
+
+/**
+ * @brief Formats the Date header of the worker, then waits for the next
+ *        second.
+ *
+ * The responses copy the line as it is, the clock gets read and formatted
+ * once a second rather than once a response.
+ */
+static void on_date_timer(uv_timer_t *handle) {
+  worker_t *worker = (worker_t *)handle->data;
+  uv_timeval64_t now;
+  uv_gettimeofday(&now);
+  char date[HTTP_DATE_SIZE];
+  http_date_format(now.tv_sec, date);
+  worker->length_date_header = snprintf(
+      worker->date_header, DATE_HEADER_SIZE, "Date: %s\r\n", date);
+  // right after the second changes
+  uv_timer_start(handle, on_date_timer, 1000 - now.tv_usec / 1000, 0);
+}
+
+static void on_worker_stop(uv_async_t *handle) {
+  worker_t *worker = (worker_t *)handle->data;
+  uv_stop(worker->loop);
+}
+
+static void print_pool(const worker_t *worker, const char *name,
+                       const pool_t *pool) {
+  fprintf(stdout,
+          "worker %u %s: %u in use (peak %u), %u free, %" PRIu64
+          " gets, %" PRIu64 " allocated, %" PRIu64 " freed\n",
+          worker->id, name, pool->in_use, pool->peak_in_use, pool->num_free,
+          pool->gets, pool->mallocs, pool->frees);
+}
+
+static void on_worker_stats(uv_async_t *handle) {
+  const worker_t *worker = (worker_t *)handle->data;
+  print_pool(worker, "read buffers", &worker->read_buffers);
+  fprintf(stdout, "worker %u large read buffers: %" PRIu64 "\n", worker->id,
+          worker->large_read_buffers);
+  print_pool(worker, "clients", &worker->clients);
+  print_pool(worker, "requests", &worker->requests);
+  print_pool(worker, "write requests", &worker->write_reqs);
+  print_pool(worker, "fs requests", &worker->fs_reqs);
+  print_pool(worker, "io_uring requests", &worker->uring_reqs);
+  print_pool(worker, "response headers", &worker->headers);
+  fprintf(stdout,
+          "worker %u response writes: %" PRIu64 " direct, %" PRIu64
+          " partial, %" PRIu64 " queued\n",
+          worker->id, worker->writes_direct, worker->writes_partial,
+          worker->writes_queued);
+  fflush(stdout);
+}
+
+#ifdef SIGUSR1
+static void stats_handler(uv_signal_t *handle, int signum) {
+  UNUSED(signum);
+  webserver_t *ws = (webserver_t *)handle->data;
+  size_t rss = 0;
+  uv_resident_set_memory(&rss);
+  fprintf(stdout, "rss: %zu KiB\n", rss / 1024);
+  // every worker prints its own counters on its loop
+  for (uint32_t i = 0; i < ws->num_workers; i++) {
+    if (ws->workers[i].status == 0)
+      uv_async_send(&ws->workers[i].stats_async);
+  }
 }
+#endif
 
 static void showLibrariesInfo(void) {
   fprintf(stdout, "use the below third party components\n");
@@ -810,82 +3012,494 @@ static void showLibrariesInfo(void) {
           STR_VERSION(UTLIST_VERSION));
 }
 
-int webserver(uv_loop_t *ev_loop, webconfig_t *config) {
-  if (ev_loop == NULL)
-    return -1;
+/**
+ * @brief Drops the file cache entries of a URL, for every set of accepted
+ *        encodings, and those of the plain file of a precompressed variant.
+ */
+static void remove_cached_url(worker_t *worker, const char *url, size_t len) {
+  char key[MAX_PATH_LENGTH + 2];
+  if (len >= MAX_PATH_LENGTH) {
+    return;
+  }
+  memcpy(key, url, len);
+  filecache_remove(&worker->filecache, key, len);
+  key[len] = '\0';
+  for (uint32_t accepted = 1; accepted < (uint32_t)1 << num_content_encodings;
+       accepted++) {
+    key[len + 1] = (char)accepted;
+    filecache_remove(&worker->filecache, key, len + 2);
+  }
 
-  loop = ev_loop;
+  for (int i = 0; i < num_content_encodings; i++) {
+    const size_t length_suffix = strlen(content_encodings[i].suffix);
+    if (len > length_suffix &&
+        memcmp(url + len - length_suffix, content_encodings[i].suffix,
+               length_suffix) == 0) {
+      remove_cached_url(worker, url, len - length_suffix);
+    }
+  }
+}
 
-  // Set configuration if provided
-  if (config != NULL) {
-    web_config = config;
+/**
+ * @brief Drops the cached content of a changed path below www_root.
+ *
+ * @param worker Pointer to the worker.
+ * @param path   The changed path, as a normalized URL.
+ * @param len    Length of the path.
+ * @param tree   true if everything below path may have changed.
+ */
+static void drop_changed(worker_t *worker, const char *path, size_t len,
+                         bool tree) {
+  // the fd cache is keyed by the filesystem path
+  char full[MAX_PATH_LENGTH];
+  const int length_full = snprintf(full, sizeof(full), "%s%.*s",
+                                   worker->config->www_root, (int)len, path);
+  if (tree) {
+    filecache_remove_tree(&worker->filecache, path, len);
+    fdcache_remove_tree(&worker->fdcache, full, length_full);
   } else {
-    // Use default configuration
-    // (optional: set default configuration)
+    fdcache_remove(&worker->fdcache, full, length_full);
   }
+  remove_cached_url(worker, path, len);
+}
 
-  // Initialize signal handlers
-  uv_signal_init(loop, &sigint_handle);
-  uv_signal_init(loop, &sigterm_handle);
+// the changes queued by on_www_change(), on the loop of the worker
+static void on_worker_changes(uv_async_t *handle) {
+  worker_t *worker = (worker_t *)handle->data;
+  uv_mutex_lock(&worker->changes_lock);
+  www_change_t *changes = worker->changes;
+  worker->changes = NULL;
+  uv_mutex_unlock(&worker->changes_lock);
+
+  www_change_t *elt, *tmp;
+  DL_FOREACH_SAFE(changes, elt, tmp) {
+    drop_changed(worker, elt->path, elt->length_path, elt->tree);
+    DL_DELETE(changes, elt);
+    free(elt);
+  }
+}
 
-  // Register signal handlers
-  uv_signal_start(&sigint_handle, signal_handler, SIGINT);
-  uv_signal_start(&sigterm_handle, signal_handler, SIGTERM);
+static void free_changes(worker_t *worker) {
+  www_change_t *elt, *tmp;
+  DL_FOREACH_SAFE(worker->changes, elt, tmp) {
+    DL_DELETE(worker->changes, elt);
+    free(elt);
+  }
+}
 
-  // Initialize HTTP parser settings
-  llhttp_settings_init(&settings);
-  settings.on_message_begin = on_message_begin;
-  settings.on_url = on_url;
-  settings.on_status = on_status;
-  settings.on_header_field = on_header_field;
-  settings.on_header_value = on_header_value;
-  settings.on_message_complete = on_message_complete;
-  settings.on_headers_complete = on_headers_complete;
-  settings.on_body = on_body;
-
-  // Initialize TCP server
-  uv_tcp_t server;
-  uv_tcp_init(loop, &server);
-
-  // Bind server to specified address and port
+/**
+ * @brief Hands a change below www_root to every worker.
+ *
+ * The server has a single watch on the loop of the caller, the workers drop
+ * their cached content on their own loop.
+ *
+ * @param watch Pointer to the watch of the server.
+ * @param path  The changed path, as a normalized URL.
+ * @param len   Length of the path.
+ * @param tree  true if everything below path may have changed.
+ */
+static void on_www_change(fswatch_t *watch, const char *path, size_t len,
+                          bool tree) {
+  webserver_t *ws = (webserver_t *)watch->data;
+  for (uint32_t i = 0; i < ws->num_workers; i++) {
+    worker_t *worker = &ws->workers[i];
+    www_change_t *change = malloc(sizeof(www_change_t) + len + 1);
+    if (change == NULL) {
+      // cached content then lives until filecache_valid
+      continue;
+    }
+    change->tree = tree;
+    change->length_path = len;
+    memcpy(change->path, path, len);
+    change->path[len] = '\0';
+    uv_mutex_lock(&worker->changes_lock);
+    DL_APPEND(worker->changes, change);
+    uv_mutex_unlock(&worker->changes_lock);
+    uv_async_send(&worker->changes_async);
+  }
+}
+
+/**
+ * @brief Starts the watch of www_root on the loop of the caller.
+ */
+static void start_www_watch(webserver_t *ws, const webconfig_t *config) {
+  if (!config->www_watch) {
+    return;
+  }
+  ws->fswatch.data = ws;
+  const int r =
+      fswatch_start(&ws->fswatch, ws->loop, config->www_root, on_www_change);
+  if (r != 0) {
+    // still served, cached content then lives until filecache_valid
+    fprintf(stderr, "Can't watch %s: %s\n", config->www_root,
+            uv_strerror(r));
+  }
+}
+
+/**
+ * @brief Binds the listen socket of a worker.
+ *
+ * The socket is created up front so SO_REUSEPORT can be set before bind(),
+ * this allows every worker to own a listen socket on the same port and lets
+ * the kernel distribute the incoming connections between them.
+ *
+ * @param worker Pointer to the worker owning the listen socket.
+ *
+ * @return Returns 0 on success, or a libuv error code.
+ */
+static int listen_worker(worker_t *worker) {
+  const webconfig_t *web_config = worker->config;
   struct sockaddr_in bind_addr;
-  uv_ip4_addr(web_config->host, web_config->port, &bind_addr);
-  uv_tcp_bind(&server, (const struct sockaddr *)&bind_addr, 0);
+  int r = uv_ip4_addr(web_config->host, web_config->port, &bind_addr);
+  if (r)
+    return r;
+
+  r = uv_tcp_init_ex(worker->loop, &worker->server, AF_INET);
+  if (r)
+    return r;
+  worker->server.data = worker;
+
+#ifdef SO_REUSEPORT
+  uv_os_fd_t fd;
+  const int on = 1;
+  uv_fileno((uv_handle_t *)&worker->server, &fd);
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0)
+    return uv_translate_sys_error(errno);
+#endif
+
+  r = uv_tcp_bind(&worker->server, (const struct sockaddr *)&bind_addr, 0);
+  if (r)
+    return r;
 
   // Start listening for incoming connections
-  int r = uv_listen((uv_stream_t *)&server, SOMAXCONN, on_connection);
-  if (r) {
-    fprintf(stderr, "Listen error %s\n", uv_strerror(r));
-    return -1;
-  }
+  return uv_listen((uv_stream_t *)&worker->server, SOMAXCONN, on_connection);
+}
 
-  // Print server information
-  fprintf(stdout, "Launch MingleJet...\n\n");
-  showLibrariesInfo();
-  fprintf(stdout, "\n");
-  // Print server listening information
-  fprintf(stdout, "Server listening on port %d...\n\n", web_config->port);
+/**
+ * @brief Runs the event loop of a worker until it gets stopped.
+ *
+ * @param worker Pointer to the worker, the loop must be initialized.
+ *
+ * @return Returns the result of uv_run(), or -1 if listening failed.
+ */
+static int run_worker(worker_t *worker) {
+  uv_loop_t *loop = worker->loop;
+  loop->data = worker;
 
-  // Setup timer for cleanup
-  setup_cleanup_timer(loop);
+  // Initialize HTTP parser settings
+  llhttp_settings_t *settings = &worker->settings;
+  llhttp_settings_init(settings);
+  settings->on_message_begin = on_message_begin;
+  settings->on_url = on_url;
+  settings->on_url_complete = on_url_complete;
+  settings->on_status = on_status;
+  settings->on_header_field = on_header_field;
+  settings->on_header_value = on_header_value;
+  settings->on_header_value_complete = on_header_value_complete;
+  settings->on_message_complete = on_message_complete;
+  settings->on_headers_complete = on_headers_complete;
+  settings->on_body = on_body;
+
+  uv_async_init(loop, &worker->stop_async, on_worker_stop);
+  worker->stop_async.data = worker;
+  uv_async_init(loop, &worker->stats_async, on_worker_stats);
+  worker->stats_async.data = worker;
+  uv_async_init(loop, &worker->changes_async, on_worker_changes);
+  worker->changes_async.data = worker;
+  uv_timer_init(loop, &worker->date_timer);
+  worker->date_timer.data = worker;
+  on_date_timer(&worker->date_timer);
+  http_date_cache_init(&worker->last_modified);
+
+  const webconfig_t *web_config = worker->config;
+  // room for a read once compacted
+  const uint32_t read_buffer_size =
+      web_config->read_buffer_size > 2 * READ_BUFFER_MIN_FREE
+          ? web_config->read_buffer_size
+          : 2 * READ_BUFFER_MIN_FREE;
+  pool_init(&worker->read_buffers, sizeof(read_buffer_t) + read_buffer_size,
+            web_config->read_buffer_pool, 0);
+  pool_init(&worker->clients, sizeof(client_t), 0, POOL_SLAB_OBJECTS);
+  pool_init(&worker->requests, sizeof(request_t), 0, POOL_SLAB_OBJECTS);
+  pool_init(&worker->write_reqs, sizeof(uv_write_t), 0, POOL_SLAB_OBJECTS);
+  pool_init(&worker->fs_reqs, sizeof(uv_fs_t), 0, POOL_SLAB_OBJECTS);
+  pool_init(&worker->uring_reqs, sizeof(uring_req_t), 0, POOL_SLAB_OBJECTS);
+  pool_init(&worker->headers, RESPONSE_HEADER_SIZE, 0, POOL_SLAB_OBJECTS);
+  if (filecache_init(&worker->filecache,
+                     web_config->filecache_size / worker->num_workers,
+                     web_config->filecache_max_file,
+                     web_config->filecache_valid) != 0 ||
+      filecache_init(&worker->compcache,
+                     web_config->compress_cache_size / worker->num_workers,
+                     web_config->compress_max_size,
+                     web_config->filecache_valid) != 0) {
+    worker->status = UV_ENOMEM;
+  } else {
+    worker->status =
+        fdcache_init(&worker->fdcache, loop, web_config->fdcache_max,
+                     web_config->fdcache_valid, web_config->fdcache_inactive);
+  }
+  if (worker->status == 0 &&
+      web_config->file_engine == FILE_ENGINE_IO_URING) {
+    const int r = uring_init(&worker->uring, loop, URING_ENTRIES);
+    if (r != 0) {
+      fprintf(stderr, "io_uring not available (%s), using the threadpool\n",
+              uv_strerror(r));
+    }
+  }
+  if (worker->status == 0) {
+    worker->status = listen_worker(worker);
+  }
+  if (worker->ready != NULL)
+    uv_sem_post(worker->ready);
 
-  // Run libuv event loop
-  int ret = uv_run(loop, UV_RUN_DEFAULT);
+  int ret = -1;
+  if (worker->status) {
+    fprintf(stderr, "Listen error %s\n", uv_strerror(worker->status));
+  } else {
+    // Run libuv event loop
+    ret = uv_run(loop, UV_RUN_DEFAULT);
 
-  uv_timer_stop(&release_timer);
-  uv_close((uv_handle_t *)&release_timer, NULL);
+    uv_timer_stop(&worker->date_timer);
+    fdcache_stop(&worker->fdcache);
+    uring_stop(&worker->uring);
+  }
+  if (worker->fswatch != NULL) {
+    fswatch_stop(worker->fswatch);
+  }
 
   // Release resources
   uv_walk(loop, walk_cb, 0);
   uv_run(loop, UV_RUN_DEFAULT); // Run pending callbacks
+  // the requests still in the ring get released by their callbacks
+  uring_destroy(&worker->uring);
 
   // Clean up resources and close event loop
-  cleanup_resources();
+  cleanup_resources(worker);
+  filecache_destroy(&worker->filecache);
+  filecache_destroy(&worker->compcache);
+  fdcache_destroy(&worker->fdcache);
+  pool_destroy(&worker->read_buffers);
+  pool_destroy(&worker->clients);
+  pool_destroy(&worker->requests);
+  pool_destroy(&worker->write_reqs);
+  pool_destroy(&worker->fs_reqs);
+  pool_destroy(&worker->uring_reqs);
+  pool_destroy(&worker->headers);
+  return ret;
+}
+
+static void worker_thread(void *arg) {
+  worker_t *worker = (worker_t *)arg;
+  run_worker(worker);
+  uv_loop_close(worker->loop);
+}
+
+static void stop_workers(webserver_t *ws, uint32_t started) {
+  for (uint32_t i = 0; i < started; i++) {
+    // a worker failed to listen has already left its loop
+    if (ws->workers[i].status == 0)
+      uv_async_send(&ws->workers[i].stop_async);
+  }
+  for (uint32_t i = 0; i < started; i++) {
+    uv_thread_join(&ws->workers[i].thread);
+  }
+}
+
+/**
+ * @brief Serializes the error pages, a "<status>.html" of
+ *        config->error_pages_dir replaces the built-in page of its status.
+ *
+ * @return Returns 0 on success, or UV_ENOMEM.
+ */
+static int load_error_pages(webserver_t *ws, const webconfig_t *config) {
+  const mime_type_t *html = mime_table_lookup(&ws->mime_types, ".html");
+  for (int i = 0; i < NUM_ERROR_PAGES; i++) {
+    const llhttp_status_t status = error_page_statuses[i].status;
+    const char *content = error_page_statuses[i].content;
+    size_t length = error_page_statuses[i].length;
+    char *custom = NULL;
+    if (config->error_pages_dir != NULL) {
+      char path[MAX_PATH_LENGTH];
+      snprintf(path, sizeof(path), "%s/%d.html", config->error_pages_dir,
+               status);
+      const int r = read_file(path, &custom, &length);
+      if (r == UV_ENOMEM) {
+        return r;
+      }
+      if (r == 0) {
+        content = custom;
+      } else if (r != UV_ENOENT) {
+        fprintf(stderr, "error page %s not loaded: %s\n", path,
+                uv_strerror(r));
+      }
+    }
+
+    char header[RESPONSE_HEADER_SIZE];
+    const uint32_t len = sizeof(header);
+    int cnt = make_header_status(status, header, len);
+    cnt += make_header_content_type(html, header + cnt, len - cnt);
+    cnt += make_header_content_length(length, header + cnt, len - cnt);
+    error_page_t *page = &ws->error_pages[i];
+    page->data = malloc(cnt + 2 + length);
+    if (page->data == NULL) {
+      free(custom);
+      return UV_ENOMEM;
+    }
+    memcpy(page->data, header, cnt);
+    memcpy(page->data + cnt, "\r\n", 2);
+    memcpy(page->data + cnt + 2, content, length);
+    page->length_header = cnt;
+    page->length = cnt + 2 + length;
+    free(custom);
+  }
+  return 0;
+}
+
+static void free_error_pages(webserver_t *ws) {
+  for (int i = 0; i < NUM_ERROR_PAGES; i++) {
+    free(ws->error_pages[i].data);
+  }
+}
+
+/**
+ * @brief Starts one thread per worker, each running its own event loop.
+ *
+ * @return Returns the number of workers started. If a worker fails to listen
+ *         all the started workers are stopped again and 0 is returned.
+ */
+static uint32_t start_workers(webserver_t *ws) {
+  uv_sem_t ready;
+  uint32_t started = 0;
+  bool failed = false;
+
+  uv_sem_init(&ready, 0);
+  for (; started < ws->num_workers; started++) {
+    worker_t *worker = &ws->workers[started];
+    worker->ready = &ready;
+    if (uv_loop_init(&worker->thread_loop) != 0)
+      break;
+    worker->loop = &worker->thread_loop;
+    if (uv_thread_create(&worker->thread, worker_thread, worker) != 0) {
+      uv_loop_close(worker->loop);
+      break;
+    }
+  }
+
+  // wait until every worker has its listen socket up
+  for (uint32_t i = 0; i < started; i++) {
+    uv_sem_wait(&ready);
+  }
+  uv_sem_destroy(&ready);
+
+  for (uint32_t i = 0; i < started; i++) {
+    ws->workers[i].ready = NULL;
+    if (ws->workers[i].status)
+      failed = true;
+  }
+
+  if (failed || started != ws->num_workers) {
+    stop_workers(ws, started);
+    return 0;
+  }
+  return started;
+}
+
+int webserver(uv_loop_t *ev_loop, webconfig_t *config) {
+  if (ev_loop == NULL || config == NULL)
+    return -1;
+
+  webserver_t ws;
+  memset(&ws, 0, sizeof(ws));
+  ws.loop = ev_loop;
+  ws.num_workers = config->workers;
+  if (ws.num_workers == 0) {
+    ws.num_workers = uv_available_parallelism();
+  }
+
+  ws.workers = calloc(ws.num_workers, sizeof(worker_t));
+  if (ws.workers == NULL)
+    return -1;
+  int r = mime_table_init(&ws.mime_types, config->mime_types_file);
+  if (r == UV_ENOMEM) {
+    free(ws.workers);
+    return -1;
+  }
+  if (r != 0) {
+    fprintf(stderr, "mime types %s not loaded: %s\n", config->mime_types_file,
+            uv_strerror(r));
+  }
+  if (load_error_pages(&ws, config) != 0) {
+    free_error_pages(&ws);
+    mime_table_free(&ws.mime_types);
+    free(ws.workers);
+    return -1;
+  }
+  for (uint32_t i = 0; i < ws.num_workers; i++) {
+    ws.workers[i].id = i;
+    ws.workers[i].num_workers = ws.num_workers;
+    ws.workers[i].config = config;
+    ws.workers[i].mime_types = &ws.mime_types;
+    ws.workers[i].error_pages = ws.error_pages;
+    uv_mutex_init(&ws.workers[i].changes_lock);
+  }
+
+  // Initialize signal handlers
+  uv_signal_init(ev_loop, &ws.sigint_handle);
+  uv_signal_init(ev_loop, &ws.sigterm_handle);
+  ws.sigint_handle.data = &ws;
+  ws.sigterm_handle.data = &ws;
+
+  // Register signal handlers
+  uv_signal_start(&ws.sigint_handle, signal_handler, SIGINT);
+  uv_signal_start(&ws.sigterm_handle, signal_handler, SIGTERM);
+#ifdef SIGUSR1
+  uv_signal_init(ev_loop, &ws.sigusr1_handle);
+  ws.sigusr1_handle.data = &ws;
+  uv_signal_start(&ws.sigusr1_handle, stats_handler, SIGUSR1);
+#endif
 
-  // the following will release in uv_walk()
-  // uv_signal_stop(&sigint_handle);
-  // uv_signal_stop(&sigterm_handle);
+  // Print server information
+  fprintf(stdout, "Launch MingleJet...\n\n");
+  showLibrariesInfo();
+  fprintf(stdout, "\n");
 
+  int ret;
+  if (ws.num_workers == 1) {
+    // single worker, run it on the loop of the caller
+    ws.workers[0].loop = ev_loop;
+    // stopped by the worker, before its loop gets closed
+    ws.workers[0].fswatch = &ws.fswatch;
+    start_www_watch(&ws, config);
+    // Print server listening information
+    fprintf(stdout, "Server listening on port %d...\n\n", config->port);
+    ret = run_worker(&ws.workers[0]);
+  } else if (start_workers(&ws) == 0) {
+    ret = -1;
+    uv_walk(ev_loop, walk_cb, 0);
+    uv_run(ev_loop, UV_RUN_DEFAULT);
+  } else {
+    // Print server listening information
+    fprintf(stdout, "Server listening on port %d with %u workers...\n\n",
+            config->port, ws.num_workers);
+    start_www_watch(&ws, config);
+    ret = uv_run(ev_loop, UV_RUN_DEFAULT);
+    // no change gets handed to the workers anymore
+    fswatch_stop(&ws.fswatch);
+    stop_workers(&ws, ws.num_workers);
+
+    // the signal handlers will release in uv_walk()
+    uv_walk(ev_loop, walk_cb, 0);
+    uv_run(ev_loop, UV_RUN_DEFAULT);
+  }
+
+  for (uint32_t i = 0; i < ws.num_workers; i++) {
+    free_changes(&ws.workers[i]);
+    uv_mutex_destroy(&ws.workers[i].changes_lock);
+  }
+  free(ws.workers);
+  mime_table_free(&ws.mime_types);
+  free_error_pages(&ws);
   fprintf(stdout, "Server Shutdown now\n");
   return ret;
 }
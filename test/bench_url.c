@@ -0,0 +1,68 @@
+/*
+ * Micro-benchmark of url_normalize_path() against the allocating
+ * validate_and_normalize_path(), built with -DBUILD_BENCHMARKS=ON:
+ *
+ *   ./bench_url [iterations]
+ */
+#include "url.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *paths[] = {
+    "/",
+    "/index.html",
+    "/static/js/app.3f2a9c.min.js",
+    "/assets/fonts/Inter-Regular.woff2",
+    "/docs/api/v1/reference/requests.html",
+    "/images//thumbs/./2024/photo_0001.jpg",
+    "/a/b/../../c/./d/index.html",
+    "/files/My%20Document%20(final).pdf",
+};
+#define NUM_PATHS (sizeof(paths) / sizeof(paths[0]))
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  const long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+  size_t lengths[NUM_PATHS];
+  for (size_t i = 0; i < NUM_PATHS; i++) {
+    lengths[i] = strlen(paths[i]);
+  }
+  size_t sink = 0;
+
+  double start = now();
+  for (long n = 0; n < iterations; n++) {
+    for (size_t i = 0; i < NUM_PATHS; i++) {
+      char *path = validate_and_normalize_path(paths[i]);
+      sink += path[1];
+      free(path);
+    }
+  }
+  const double old_time = now() - start;
+
+  char buf[256];
+  start = now();
+  for (long n = 0; n < iterations; n++) {
+    for (size_t i = 0; i < NUM_PATHS; i++) {
+      // the copy stands for the request target already in the arena
+      memcpy(buf, paths[i], lengths[i]);
+      sink += url_normalize_path(buf, lengths[i]);
+    }
+  }
+  const double new_time = now() - start;
+
+  const double calls = (double)iterations * NUM_PATHS;
+  printf("validate_and_normalize_path: %8.1f ns/path\n",
+         old_time / calls * 1e9);
+  printf("url_normalize_path:          %8.1f ns/path\n",
+         new_time / calls * 1e9);
+  printf("checksum %zu\n", sink);
+  return 0;
+}
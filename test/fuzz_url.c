@@ -0,0 +1,53 @@
+/*
+ * libFuzzer target for url_normalize_path(), built with -DBUILD_FUZZERS=ON
+ * (clang only):
+ *
+ *   ./fuzz_url -max_len=512
+ *
+ * Aborts when a normalized path breaks one of its invariants.
+ */
+#include "url.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void check(int ok) {
+  if (!ok) {
+    abort();
+  }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  char *path = malloc(size + 1);
+  if (path == NULL) {
+    return 0;
+  }
+  memcpy(path, data, size);
+  const int len = url_normalize_path(path, size);
+  if (len < 0) {
+    free(path);
+    return 0;
+  }
+
+  // starts at the root, never grows, no NUL, no backslash
+  check(len >= 1 && (size_t)len <= size && path[0] == '/');
+  check(strlen(path) == (size_t)len && memchr(path, '\\', len) == NULL);
+  // no empty, "." or ".." segment left
+  check(strstr(path, "//") == NULL && strstr(path, "/./") == NULL &&
+        strstr(path, "/../") == NULL);
+  check(!(len >= 2 && strcmp(path + len - 2, "/.") == 0));
+  check(!(len >= 3 && strcmp(path + len - 3, "/..") == 0));
+
+  // without escapes left, normalizing again changes nothing
+  if (memchr(path, '%', len) == NULL) {
+    char *again = malloc(len + 1);
+    if (again != NULL) {
+      memcpy(again, path, len + 1);
+      check(url_normalize_path(again, len) == len &&
+            memcmp(again, path, len) == 0);
+      free(again);
+    }
+  }
+  free(path);
+  return 0;
+}
@@ -5,10 +5,45 @@ testHost = 'http://localhost:8080'
 def test_get_request():
     response = requests.get(testHost)
     assert response.status_code == 200
+    # 每个响应都带有Date字段
+    assert response.headers['date'].endswith(' GMT')
     # assert 'content_type' in response.headers
     # assert 'application/json' in response.headers['content_type']
     # 这里可以添加更多的断言，验证响应的内容等
 
+# 发送Range请求
+def test_range_request():
+    response = requests.get(testHost, headers={'Range': 'bytes=0-9'})
+    assert response.status_code == 206
+    assert response.headers['content-range'].startswith('bytes 0-9/')
+    assert len(response.content) == 10
+
+# 发送条件GET请求
+def test_conditional_request():
+    response = requests.get(testHost)
+    assert 'etag' in response.headers
+    assert 'last-modified' in response.headers
+    response = requests.get(testHost,
+                            headers={'If-None-Match': response.headers['etag']})
+    assert response.status_code == 304
+    assert len(response.content) == 0
+
+# 发送百分号编码路径的请求
+def test_encoded_path_request():
+    response = requests.get(testHost + '/%69ndex.html')
+    assert response.status_code == 200
+    response = requests.get(testHost + '/%2e%2e/index.html')
+    assert response.status_code == 200
+    # 编码的斜杠被拒绝
+    response = requests.get(testHost + '/a%2Fb')
+    assert response.status_code == 400
+
+# 请求不存在的文件
+def test_not_found_request():
+    response = requests.get(testHost + '/not-found.html')
+    assert response.status_code == 404
+    assert int(response.headers['content-length']) == len(response.content)
+
 # 发送POST请求
 def test_post_request():
     payload = {'key1': 'value1', 'key2': 'value2'}
@@ -34,6 +69,10 @@ def test_delete_request():
 
 if __name__ == "__main__":
     test_get_request()
+    test_range_request()
+    test_conditional_request()
+    test_encoded_path_request()
+    test_not_found_request()
     # test_post_request()
     # test_put_request()
     # test_delete_request()